@@ -0,0 +1,102 @@
+#include "JpegCrop.h"
+#include "JpegScan.h"
+#include <stdio.h>
+
+// 把区域内的块按原表重新编码
+class CropVisitor : public JpegBlockVisitor
+{
+public:
+    CropVisitor(JpegScan& scan, JpegBitWriter& w, int mx0, int my0, int mx1, int my1)
+        : _scan(scan), _w(w), _mx0(mx0), _my0(my0), _mx1(mx1), _my1(my1), ok(true)
+    {
+        for (int c = 0; c < JPEG_MAX_COMPONENTS; c++) _pred[c] = 0;
+    }
+
+    bool block(int c, int bx, int by, const int16_t* zz) override
+    {
+        const JpegComponent& jc = _scan.comp[c];
+        int mx = bx / jc.h;
+        int my = by / jc.v;
+
+        // 区域下方的数据不需要解码
+        if (my >= _my1) return false;
+        if (my < _my0 || mx < _mx0 || mx >= _mx1) return true;
+
+        if (!jpegEncodeBlock(_w, zz, &_pred[c], _scan.dc[jc.td], _scan.ac[jc.ta])) {
+            ok = false;
+            return false;
+        }
+        return !_w.overflow();
+    }
+
+private:
+    JpegScan& _scan;
+    JpegBitWriter& _w;
+    int _mx0, _my0, _mx1, _my1;
+    int _pred[JPEG_MAX_COMPONENTS];
+
+public:
+    bool ok;
+};
+
+static size_t cropScan(JpegScan& scan, const uint8_t* src, size_t len, const JpegRect& roi,
+                       uint8_t* dst, size_t cap, JpegRect* actual)
+{
+    if (!scan.parse(src, len)) return 0;
+
+    // 向外对齐到MCU边界
+    int mw = scan.mcuWidth();
+    int mh = scan.mcuHeight();
+    int x0 = roi.x < 0 ? 0 : roi.x;
+    int y0 = roi.y < 0 ? 0 : roi.y;
+    int x1 = roi.x + roi.w;
+    int y1 = roi.y + roi.h;
+    if (x1 > scan.width) x1 = scan.width;
+    if (y1 > scan.height) y1 = scan.height;
+    if (x0 >= x1 || y0 >= y1) return 0;
+
+    int mx0 = x0 / mw;
+    int my0 = y0 / mh;
+    int mx1 = (x1 + mw - 1) / mw;
+    int my1 = (y1 + mh - 1) / mh;
+
+    // 靠右/下边缘时保留原图不足一个MCU的部分
+    int width = (mx1 * mw < scan.width ? mx1 * mw : scan.width) - mx0 * mw;
+    int height = (my1 * mh < scan.height ? my1 * mh : scan.height) - my0 * mh;
+
+    JpegBitWriter w(dst, cap);
+    jpegWriteHeaders(w, scan, width, height);
+    if (w.overflow()) return 0;
+
+    CropVisitor v(scan, w, mx0, my0, mx1, my1);
+    if (!scan.decode(v) || !v.ok) return 0;
+
+    w.flushBits();
+    w.putByte(0xFF);
+    w.putByte(0xD9);
+    if (w.overflow()) return 0;
+
+    if (actual) {
+        actual->x = mx0 * mw;
+        actual->y = my0 * mh;
+        actual->w = width;
+        actual->h = height;
+    }
+    return w.length();
+}
+
+size_t jpegCrop(const uint8_t* src, size_t len, const JpegRect& roi,
+                uint8_t* dst, size_t cap, JpegRect* actual)
+{
+    JpegScan* scan = JpegScan::create();
+    if (scan == NULL) return 0;
+    size_t n = cropScan(*scan, src, len, roi, dst, cap, actual);
+    delete scan;
+    return n;
+}
+
+bool jpegParseRect(const char* s, JpegRect* roi)
+{
+    if (sscanf(s, "%d,%d,%d,%d", &roi->x, &roi->y, &roi->w, &roi->h) != 4) return false;
+    return roi->x >= 0 && roi->y >= 0 && roi->w > 0 && roi->h > 0;
+}
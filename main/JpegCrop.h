@@ -0,0 +1,24 @@
+#ifndef JPEGCROP_H_
+#define JPEGCROP_H_
+
+#include <stdint.h>
+#include <stddef.h>
+
+// 感兴趣区域，像素坐标
+struct JpegRect {
+    int x, y, w, h;
+};
+
+// 在JPEG域中无损裁剪：只熵解码系数，把落在区域内的MCU按原来的Huffman表
+// 重新输出，并重写SOF尺寸和DC预测。不做IDCT，也不重新量化。
+//
+// 区域会向外扩展到MCU边界（通常为16x8或16x16像素）并限制在图像内，
+// 实际裁剪的区域写入 actual（可为NULL）。
+// 返回写入dst的字节数；源图像不受支持、区域为空或dst太小时返回0。
+size_t jpegCrop(const uint8_t* src, size_t len, const JpegRect& roi,
+                uint8_t* dst, size_t cap, JpegRect* actual);
+
+// 解析 "x,y,w,h" 格式的区域参数
+bool jpegParseRect(const char* s, JpegRect* roi);
+
+#endif //JPEGCROP_H_
@@ -0,0 +1,274 @@
+#include "JpegHuffOpt.h"
+#include <stdlib.h>
+#include <string.h>
+
+// 统计一个块用到的DC/AC符号，与jpegEncodeBlock的符号完全对应
+static void countBlock(const int16_t* zz, int* pred, uint32_t* dcFreq, uint32_t* acFreq)
+{
+    dcFreq[jpegBitLength(zz[0] - *pred)]++;
+    *pred = zz[0];
+
+    int run = 0;
+    for (int k = 1; k < 64; k++) {
+        if (zz[k] == 0) {
+            run++;
+            continue;
+        }
+        while (run > 15) {
+            acFreq[0xF0]++;
+            run -= 16;
+        }
+        acFreq[(run << 4) | jpegBitLength(zz[k])]++;
+        run = 0;
+    }
+    if (run > 0) acFreq[0x00]++;
+}
+
+// 统计符号，并在已有表时用新表重新编码
+class HuffOptVisitor : public JpegBlockVisitor
+{
+public:
+    HuffOptVisitor(JpegHuffOptimizer& opt, JpegScan& scan, JpegBitWriter* w)
+        : ok(true), _opt(opt), _scan(scan), _w(w)
+    {
+        for (int c = 0; c < JPEG_MAX_COMPONENTS; c++) _pred[c] = 0;
+    }
+
+    bool block(int c, int bx, int by, const int16_t* zz) override
+    {
+        int td = _scan.comp[c].td;
+        int ta = _scan.comp[c].ta;
+        if (_w == NULL) {
+            countBlock(zz, &_pred[c], _opt._freqDc[td], _opt._freqAc[ta]);
+            return true;
+        }
+
+        if (!jpegEncodeBlock(*_w, zz, &_pred[c], _opt._dc[td], _opt._ac[ta],
+                             _opt._freqDc[td], _opt._freqAc[ta]) || _w->overflow()) {
+            ok = false;
+            return false;
+        }
+        return true;
+    }
+
+    bool ok;
+
+private:
+    JpegHuffOptimizer& _opt;
+    JpegScan& _scan;
+    JpegBitWriter* _w;
+    int _pred[JPEG_MAX_COMPONENTS];
+};
+
+bool jpegOptimalTable(const uint32_t* freq, JpegHuffTable* t)
+{
+    // 工作区约2KB，只在重建表时用到，不占任务栈
+    struct Work {
+        uint32_t freq[257];
+        int16_t others[257];
+        uint8_t codesize[257];
+        uint8_t bits[33];
+    };
+    Work* w = (Work*)calloc(1, sizeof(Work));
+    if (w == NULL) return false;
+
+    memcpy(w->freq, freq, 256 * sizeof(uint32_t));
+    w->freq[256] = 1;  // 保留一个码点，保证没有全1的码字
+    for (int i = 0; i < 257; i++) w->others[i] = -1;
+
+    // 反复合并频率最小的两个节点（K.2 图K.1）
+    for (;;) {
+        int c1 = -1, c2 = -1;
+        uint32_t v = 0xFFFFFFFF;
+        for (int i = 0; i <= 256; i++) {
+            if (w->freq[i] && w->freq[i] <= v) {
+                v = w->freq[i];
+                c1 = i;
+            }
+        }
+        v = 0xFFFFFFFF;
+        for (int i = 0; i <= 256; i++) {
+            if (w->freq[i] && w->freq[i] <= v && i != c1) {
+                v = w->freq[i];
+                c2 = i;
+            }
+        }
+        if (c2 < 0) break;
+
+        w->freq[c1] += w->freq[c2];
+        w->freq[c2] = 0;
+
+        w->codesize[c1]++;
+        while (w->others[c1] >= 0) {
+            c1 = w->others[c1];
+            w->codesize[c1]++;
+        }
+        w->others[c1] = (int16_t)c2;
+
+        w->codesize[c2]++;
+        while (w->others[c2] >= 0) {
+            c2 = w->others[c2];
+            w->codesize[c2]++;
+        }
+    }
+
+    for (int i = 0; i <= 256; i++) {
+        if (w->codesize[i]) w->bits[w->codesize[i] > 32 ? 32 : w->codesize[i]]++;
+    }
+
+    // 把码长限制到16位（K.2 图K.3）
+    for (int i = 32; i > 16; i--) {
+        while (w->bits[i] > 0) {
+            int j = i - 2;
+            while (w->bits[j] == 0) j--;
+            w->bits[i] -= 2;
+            w->bits[i - 1]++;
+            w->bits[j + 1] += 2;
+            w->bits[j]--;
+        }
+    }
+    // 去掉保留的码点
+    int i = 16;
+    while (w->bits[i] == 0) i--;
+    w->bits[i]--;
+
+    t->bits[0] = 0;
+    memcpy(t->bits + 1, w->bits + 1, 16);
+
+    // 符号按码长排序，同码长按符号值排序
+    int p = 0;
+    for (int l = 1; l <= 32; l++) {
+        for (int s = 0; s < 256; s++) {
+            if (w->codesize[s] == l) t->vals[p++] = (uint8_t)s;
+        }
+    }
+    free(w);
+    return true;
+}
+
+JpegHuffOptimizer::JpegHuffOptimizer(int rebuildFrames, int driftPermille)
+{
+    _rebuildFrames = rebuildFrames;
+    _driftPermille = driftPermille;
+    _valid = false;
+    _sinceRebuild = 0;
+    _baseRatio = 0;
+    _dhtLen = 0;
+    frames = 0;
+    rebuilds = 0;
+    bytesIn = 0;
+    bytesOut = 0;
+    memset(_usedDc, 0, sizeof(_usedDc));
+    memset(_usedAc, 0, sizeof(_usedAc));
+}
+
+void JpegHuffOptimizer::rebuild(void)
+{
+    uint8_t* d = _dht + 4;
+    _valid = true;
+
+    for (int tc = 0; tc < 2; tc++) {
+        for (int th = 0; th < 4; th++) {
+            if (!(tc ? _usedAc[th] : _usedDc[th])) continue;
+            uint32_t* freq = tc ? _freqAc[th] : _freqDc[th];
+            JpegHuffTable* t = tc ? &_ac[th] : &_dc[th];
+
+            // 为所有可能出现的符号保留码字，旧表因此总能编码后续的帧
+            if (tc == 0) {
+                for (int s = 0; s <= 11; s++)
+                    if (freq[s] == 0) freq[s] = 1;
+            }
+            else {
+                if (freq[0x00] == 0) freq[0x00] = 1;
+                if (freq[0xF0] == 0) freq[0xF0] = 1;
+                for (int r = 0; r < 16; r++)
+                    for (int s = 1; s <= 10; s++)
+                        if (freq[(r << 4) | s] == 0) freq[(r << 4) | s] = 1;
+            }
+
+            if (!jpegOptimalTable(freq, t) || !jpegBuildHuffTable(t)) {
+                _valid = false;
+                return;
+            }
+
+            int count = 0;
+            for (int l = 1; l <= 16; l++) count += t->bits[l];
+            *d++ = (uint8_t)((tc << 4) | th);
+            memcpy(d, t->bits + 1, 16);
+            memcpy(d + 16, t->vals, count);
+            d += 16 + count;
+        }
+    }
+
+    _dhtLen = d - _dht;
+    _dht[0] = 0xFF;
+    _dht[1] = 0xC4;
+    _dht[2] = (uint8_t)((_dhtLen - 2) >> 8);
+    _dht[3] = (uint8_t)(_dhtLen - 2);
+
+    _sinceRebuild = 0;
+    _baseRatio = 0;
+    rebuilds++;
+}
+
+size_t JpegHuffOptimizer::process(const uint8_t* src, size_t len, uint8_t* dst, size_t cap)
+{
+    if (!_scan.parse(src, len)) return 0;
+
+    // 表号的使用方式变了（例如切换了灰度/彩色），旧表不能再用
+    bool usedDc[4] = { false };
+    bool usedAc[4] = { false };
+    for (int c = 0; c < _scan.ncomp; c++) {
+        usedDc[_scan.comp[c].td] = true;
+        usedAc[_scan.comp[c].ta] = true;
+    }
+    if (memcmp(usedDc, _usedDc, sizeof(usedDc)) != 0 || memcmp(usedAc, _usedAc, sizeof(usedAc)) != 0) {
+        _valid = false;
+        memcpy(_usedDc, usedDc, sizeof(usedDc));
+        memcpy(_usedAc, usedAc, sizeof(usedAc));
+    }
+
+    memset(_freqDc, 0, sizeof(_freqDc));
+    memset(_freqAc, 0, sizeof(_freqAc));
+
+    JpegBitWriter w(dst, cap);
+    bool encode = _valid;
+    if (encode) jpegWriteHeaders(w, _scan, _scan.width, _scan.height, _dht, _dhtLen);
+
+    HuffOptVisitor v(*this, _scan, encode && !w.overflow() ? &w : NULL);
+    bool ok = _scan.decode(v);
+    if (!ok) return 0;
+
+    size_t out = 0;
+    if (encode && v.ok) {
+        w.flushBits();
+        w.putByte(0xFF);
+        w.putByte(0xD9);
+        if (!w.overflow()) out = w.length();
+    }
+
+    // 到期或压缩率漂移时，用本帧的统计重建表
+    bool rebuildNow = !_valid || ++_sinceRebuild >= _rebuildFrames;
+    if (out > 0) {
+        int ratio = (int)((uint64_t)out * 1000 / len);
+        if (_baseRatio == 0)
+            _baseRatio = ratio;
+        else if (ratio > _baseRatio + _driftPermille)
+            rebuildNow = true;
+    }
+    else if (encode) {
+        rebuildNow = true;
+    }
+
+    // 统计不完整时（编码中途停止）不能用来建表，下一帧只统计不编码
+    if (encode && !v.ok)
+        _valid = false;
+    else if (rebuildNow)
+        rebuild();
+
+    if (out == 0 || out >= len) return 0;
+    frames++;
+    bytesIn += len;
+    bytesOut += out;
+    return out;
+}
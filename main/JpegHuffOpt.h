@@ -0,0 +1,63 @@
+#ifndef JPEGHUFFOPT_H_
+#define JPEGHUFFOPT_H_
+
+#include <stdint.h>
+#include <stddef.h>
+#include "JpegScan.h"
+
+// 场景自适应的Huffman表优化。
+// 传感器和fmt2jpg都使用Annex K的标准Huffman表；按实际符号统计生成的最优表
+// 通常能让帧小5-15%。系数不变，只重新熵编码，因此是无损的。
+//
+// 为了降低CPU开销，表不是每帧都重建：每帧用当前表重新编码的同时统计符号，
+// 每隔 rebuildFrames 帧，或者压缩率比建表后的第一帧变差超过 driftPermille 时，
+// 才用最近一帧的统计重建表。所有可能的符号都保留码字，因此旧表总能编码新帧。
+class JpegHuffOptimizer
+{
+public:
+    JpegHuffOptimizer(int rebuildFrames = 30, int driftPermille = 20);
+
+    // 重新熵编码src到dst，返回写入的字节数。
+    // 返回0表示本帧不输出（还没有表、源图像不受支持、dst太小或结果没有变小），
+    // 调用方应发送原帧。
+    size_t process(const uint8_t* src, size_t len, uint8_t* dst, size_t cap);
+
+    // 统计信息
+    uint32_t frames;         // 成功输出的帧数
+    uint32_t rebuilds;       // 重建表的次数
+    uint64_t bytesIn;        // 成功输出的帧的原始字节数
+    uint64_t bytesOut;       // 对应的输出字节数
+
+private:
+    void rebuild(void);
+
+    int _rebuildFrames;
+    int _driftPermille;
+    bool _valid;             // 是否已有可用的表
+    int _sinceRebuild;
+    int _baseRatio;          // 建表后第一帧的压缩率（千分比），0表示尚未记录
+
+    // 当前表，按源图像中的表号（0-3）索引，与SOS中的选择一致
+    JpegHuffTable _dc[4];
+    JpegHuffTable _ac[4];
+    bool _usedDc[4];
+    bool _usedAc[4];
+
+    // 最近一帧的符号统计
+    uint32_t _freqDc[4][256];
+    uint32_t _freqAc[4][256];
+
+    JpegScan _scan;          // 约19KB；整个优化器约48KB，应在堆上分配而不是放在任务栈上
+
+    // 输出的DHT段
+    uint8_t _dht[4 + 8 * (17 + 256)];
+    size_t _dhtLen;
+
+    friend class HuffOptVisitor;
+};
+
+// 按符号频率生成码长不超过16位的最优Huffman表（ITU T.81 K.2），只填充bits/vals。
+// 内存不足时返回false
+bool jpegOptimalTable(const uint32_t* freq, JpegHuffTable* t);
+
+#endif //JPEGHUFFOPT_H_
@@ -0,0 +1,95 @@
+#include "JpegPreview.h"
+#include "JpegScan.h"
+#include <stdlib.h>
+
+static inline uint8_t clamp255(int v)
+{
+    return v < 0 ? 0 : (v > 255 ? 255 : (uint8_t)v);
+}
+
+// 把每个块的DC值反量化后存入对应分量的平面，每块一个像素
+class DcVisitor : public JpegBlockVisitor
+{
+public:
+    DcVisitor(JpegScan& scan, uint8_t** planes, const int* stride)
+        : _scan(scan), _planes(planes), _stride(stride) {}
+
+    bool block(int c, int bx, int by, const int16_t* zz) override
+    {
+        // 与libjpeg的1x1 IDCT相同的舍入：DC * Q / 8 + 128
+        int q = _scan.qt[_scan.comp[c].tq][0];
+        _planes[c][by * _stride[c] + bx] = clamp255(((zz[0] * q + 4) >> 3) + 128);
+        return true;
+    }
+
+private:
+    JpegScan& _scan;
+    uint8_t** _planes;
+    const int* _stride;
+};
+
+static bool previewScan(JpegScan& scan, const uint8_t* src, size_t len, uint8_t* dst, size_t cap,
+                        int* width, int* height, bool* gray)
+{
+    *width = 0;
+    if (!scan.parse(src, len)) return false;
+    if (scan.ncomp != 1 && scan.ncomp != 3) return false;
+
+    int w = (scan.width + 7) / 8;
+    int h = (scan.height + 7) / 8;
+    *width = w;
+    *height = h;
+    *gray = scan.ncomp == 1;
+    if ((size_t)w * h * scan.ncomp > cap) return false;
+
+    // 每个分量一个DC平面，尺寸按MCU补齐
+    uint8_t* planes[JPEG_MAX_COMPONENTS] = { NULL };
+    int stride[JPEG_MAX_COMPONENTS];
+    bool ok = true;
+    for (int c = 0; c < scan.ncomp; c++) {
+        stride[c] = scan.mcusX * scan.comp[c].h;
+        planes[c] = (uint8_t*)malloc((size_t)stride[c] * scan.mcusY * scan.comp[c].v);
+        if (planes[c] == NULL) ok = false;
+    }
+
+    if (ok) {
+        DcVisitor v(scan, planes, stride);
+        ok = scan.decode(v);
+    }
+
+    if (ok && scan.ncomp == 1) {
+        for (int y = 0; y < h; y++)
+            for (int x = 0; x < w; x++)
+                *dst++ = planes[0][y * stride[0] + x];
+    }
+    else if (ok) {
+        // 色度分量按采样因子最近邻放大，再做YCbCr到RGB的转换（定点，16位小数）
+        for (int y = 0; y < h; y++) {
+            const uint8_t* py = planes[0] + (y * scan.comp[0].v / scan.vmax) * stride[0];
+            const uint8_t* pb = planes[1] + (y * scan.comp[1].v / scan.vmax) * stride[1];
+            const uint8_t* pr = planes[2] + (y * scan.comp[2].v / scan.vmax) * stride[2];
+            for (int x = 0; x < w; x++) {
+                int yy = py[x * scan.comp[0].h / scan.hmax];
+                int cb = pb[x * scan.comp[1].h / scan.hmax] - 128;
+                int cr = pr[x * scan.comp[2].h / scan.hmax] - 128;
+                *dst++ = clamp255(yy + ((116130 * cb + 32768) >> 16));
+                *dst++ = clamp255(yy + ((-22554 * cb - 46802 * cr + 32768) >> 16));
+                *dst++ = clamp255(yy + ((91881 * cr + 32768) >> 16));
+            }
+        }
+    }
+
+    for (int c = 0; c < scan.ncomp; c++) free(planes[c]);
+    return ok;
+}
+
+bool jpegPreview(const uint8_t* src, size_t len, uint8_t* dst, size_t cap,
+                 int* width, int* height, bool* gray)
+{
+    *width = 0;
+    JpegScan* scan = JpegScan::create();
+    if (scan == NULL) return false;
+    bool ok = previewScan(*scan, src, len, dst, cap, width, height, gray);
+    delete scan;
+    return ok;
+}
@@ -0,0 +1,18 @@
+#ifndef JPEGPREVIEW_H_
+#define JPEGPREVIEW_H_
+
+#include <stdint.h>
+#include <stddef.h>
+
+// 从JPEG的DC系数生成1/8比例的图像：每个8x8块的DC值就是该块的平均亮度/色度，
+// 只需熵解码，不做IDCT，开销远小于完整解码再缩小。
+
+// 只解析一次文件头，解码DC系数并写出预览像素到dst：
+// 彩色图像为每像素3字节的BGR顺序（与esp32-camera的PIXFORMAT_RGB888一致），
+// 灰度图像为每像素1字节。预览图的尺寸等于原图尺寸除以8向上取整。
+// 只要源图像受支持就会填写 width/height/gray；cap 小于 width * height * (gray ? 1 : 3)
+// 时不解码并返回false，调用方扩大dst后重试。源图像不受支持时 width 为0
+bool jpegPreview(const uint8_t* src, size_t len, uint8_t* dst, size_t cap,
+                 int* width, int* height, bool* gray);
+
+#endif //JPEGPREVIEW_H_
@@ -0,0 +1,468 @@
+#include "JpegScan.h"
+#include <string.h>
+#include <new>
+
+static inline int be16(const uint8_t* p)
+{
+    return (p[0] << 8) | p[1];
+}
+
+JpegScan* JpegScan::create(void)
+{
+    return new (std::nothrow) JpegScan;
+}
+
+bool jpegBuildHuffTable(JpegHuffTable* t)
+{
+    int count = 0;
+    for (int l = 1; l <= 16; l++) count += t->bits[l];
+    if (count > 256) return false;
+
+    memset(t->lookup, 0, sizeof(t->lookup));
+    memset(t->size, 0, sizeof(t->size));
+
+    int k = 0;
+    int32_t code = 0;
+    for (int l = 1; l <= 16; l++) {
+        t->valptr[l] = k;
+        t->mincode[l] = code;
+        for (int i = 0; i < t->bits[l]; i++, k++, code++) {
+            // 码字超出该长度的范围，表无效（必须在写查找表之前检查）
+            if (code >= (1 << l)) return false;
+            uint8_t sym = t->vals[k];
+            t->code[sym] = (uint16_t)code;
+            t->size[sym] = (uint8_t)l;
+
+            if (l <= JPEG_LOOKUP_BITS) {
+                int shift = JPEG_LOOKUP_BITS - l;
+                for (int j = 0; j < (1 << shift); j++)
+                    t->lookup[(code << shift) | j] = (uint16_t)((l << 8) | sym);
+            }
+        }
+        t->maxcode[l] = t->bits[l] ? code - 1 : -1;
+        code <<= 1;
+    }
+    t->maxcode[17] = 0x7FFFFFFF;
+    t->present = true;
+    return true;
+}
+
+// ==== 输出 =====================================================
+
+JpegBitWriter::JpegBitWriter(uint8_t* buf, size_t cap)
+{
+    _buf = buf;
+    _cap = cap;
+    _len = 0;
+    _overflow = false;
+    _acc = 0;
+    _nbits = 0;
+}
+
+void JpegBitWriter::putByte(uint8_t b)
+{
+    if (_len < _cap)
+        _buf[_len++] = b;
+    else
+        _overflow = true;
+}
+
+void JpegBitWriter::putBytes(const uint8_t* p, size_t n)
+{
+    if (_len + n > _cap) {
+        _overflow = true;
+        return;
+    }
+    memcpy(_buf + _len, p, n);
+    _len += n;
+}
+
+void JpegBitWriter::putBits(uint32_t bits, int size)
+{
+    _acc = (_acc << size) | (bits & ((1u << size) - 1));
+    _nbits += size;
+    while (_nbits >= 8) {
+        uint8_t b = (uint8_t)(_acc >> (_nbits - 8));
+        putByte(b);
+        if (b == 0xFF) putByte(0x00);
+        _nbits -= 8;
+    }
+}
+
+void JpegBitWriter::flushBits(void)
+{
+    if (_nbits > 0) putBits(0x7F, 8 - _nbits);
+    _acc = 0;
+}
+
+// ==== 文件头解析 ================================================
+
+bool JpegScan::parse(const uint8_t* d, size_t n)
+{
+    data = d;
+    len = n;
+    ncomp = 0;
+    restartInterval = 0;
+    nsegs = 0;
+    for (int i = 0; i < 4; i++) {
+        dc[i].present = false;
+        ac[i].present = false;
+    }
+
+    if (n < 4 || d[0] != 0xFF || d[1] != 0xD8) return false;
+
+    size_t pos = 2;
+    for (;;) {
+        // 跳到下一个标记，允许多个0xFF填充
+        while (pos < n && d[pos] != 0xFF) pos++;
+        while (pos < n && d[pos] == 0xFF) pos++;
+        if (pos >= n) return false;
+
+        size_t markerPos = pos - 1;
+        uint8_t m = d[pos++];
+        if (m == 0x01 || (m >= 0xD0 && m <= 0xD7)) continue;  // 没有长度字段的标记
+        if (m == 0xD9 || pos + 2 > n) return false;          // SOS之前的EOI
+
+        int segLen = be16(d + pos);
+        if (segLen < 2 || pos + segLen > n) return false;
+        const uint8_t* s = d + pos + 2;
+        const uint8_t* segEnd = d + pos + segLen;
+
+        if (nsegs == JPEG_MAX_SEGMENTS) return false;
+        segs[nsegs].marker = m;
+        segs[nsegs].pos = markerPos;
+        segs[nsegs].len = segLen + 2;
+        nsegs++;
+
+        switch (m)
+        {
+        case 0xC0:  // 基线
+        case 0xC1:  // 扩展顺序，Huffman
+            if (segLen < 8 || s[0] != 8) return false;
+            height = be16(s + 1);
+            width = be16(s + 3);
+            ncomp = s[5];
+            if (ncomp < 1 || ncomp > JPEG_MAX_COMPONENTS || segLen < 8 + 3 * ncomp) return false;
+            hmax = vmax = 1;
+            for (int i = 0; i < ncomp; i++) {
+                comp[i].id = s[6 + i * 3];
+                comp[i].h = s[7 + i * 3] >> 4;
+                comp[i].v = s[7 + i * 3] & 15;
+                comp[i].tq = s[8 + i * 3] & 3;
+                if (comp[i].h < 1 || comp[i].h > 4 || comp[i].v < 1 || comp[i].v > 4) return false;
+                if (comp[i].h > hmax) hmax = comp[i].h;
+                if (comp[i].v > vmax) vmax = comp[i].v;
+            }
+            // 单分量扫描是非交错的，每个MCU就是一个块
+            if (ncomp == 1) {
+                comp[0].h = comp[0].v = 1;
+                hmax = vmax = 1;
+            }
+            if (width == 0 || height == 0) return false;
+            mcusX = (width + 8 * hmax - 1) / (8 * hmax);
+            mcusY = (height + 8 * vmax - 1) / (8 * vmax);
+            break;
+
+        case 0xC4:  // DHT
+            while (s < segEnd) {
+                if (s + 17 > segEnd) return false;
+                int tc = s[0] >> 4;
+                int th = s[0] & 15;
+                if (tc > 1 || th > 3) return false;
+                JpegHuffTable* t = tc ? &ac[th] : &dc[th];
+                int count = 0;
+                t->bits[0] = 0;
+                for (int l = 1; l <= 16; l++) {
+                    t->bits[l] = s[l];
+                    count += s[l];
+                }
+                if (count > 256 || s + 17 + count > segEnd) return false;
+                memcpy(t->vals, s + 17, count);
+                if (!jpegBuildHuffTable(t)) return false;
+                s += 17 + count;
+            }
+            break;
+
+        case 0xDB:  // DQT
+            while (s < segEnd) {
+                int pq = s[0] >> 4;
+                int tq = s[0] & 3;
+                if (s + 1 + 64 * (pq + 1) > segEnd) return false;
+                for (int i = 0; i < 64; i++)
+                    qt[tq][i] = pq ? be16(s + 1 + i * 2) : s[1 + i];
+                s += 1 + 64 * (pq + 1);
+            }
+            break;
+
+        case 0xDD:  // DRI
+            if (segLen < 4) return false;
+            restartInterval = be16(s);
+            break;
+
+        case 0xDA:  // SOS
+        {
+            if (ncomp == 0) return false;  // SOF之前的SOS
+            if (segLen < 3) return false;
+            int ns = s[0];
+            // 只支持包含所有分量的单个扫描
+            if (ns != ncomp || segLen < 6 + 2 * ns) return false;
+            for (int i = 0; i < ns; i++) {
+                uint8_t cs = s[1 + i * 2];
+                int c = 0;
+                while (c < ncomp && comp[c].id != cs) c++;
+                if (c != i) return false;  // 扫描顺序与帧顺序不同，不支持
+                comp[c].td = s[2 + i * 2] >> 4;
+                comp[c].ta = s[2 + i * 2] & 15;
+                if (comp[c].td > 3 || comp[c].ta > 3) return false;
+                if (!dc[comp[c].td].present || !ac[comp[c].ta].present) return false;
+            }
+            scanStart = pos + segLen;
+            return true;
+        }
+
+        case 0xC2: case 0xC3: case 0xC5: case 0xC6: case 0xC7:
+        case 0xC9: case 0xCA: case 0xCB: case 0xCD: case 0xCE: case 0xCF:
+            return false;  // 渐进式、无损或算术编码
+
+        default:
+            break;  // APPn、COM等
+        }
+        pos += segLen;
+    }
+}
+
+// ==== 熵解码 ====================================================
+
+// 从填充过的扫描数据中读取位，遇到标记后补0。
+// 64位累加器：每次refill后至少有32位可用，足够一个码字加上它的附加位
+struct JpegBitReader {
+    const uint8_t* p;
+    const uint8_t* end;
+    uint64_t acc;
+    int nbits;
+    bool marker;
+    int zeros;     // 遇到标记后补充的0字节数，用于发现截断的数据
+
+    void fill(void)
+    {
+        while (nbits <= 56) {
+            uint64_t b = 0;
+            if (!marker && p < end) {
+                b = *p;
+                if (b != 0xFF) {
+                    p++;
+                }
+                else if (p + 1 < end && p[1] == 0x00) {
+                    p += 2;
+                }
+                else {
+                    marker = true;
+                    b = 0;
+                }
+            }
+            if (marker || p >= end) zeros++;
+            acc |= b << (56 - nbits);
+            nbits += 8;
+        }
+    }
+
+    inline void refill(void)
+    {
+        if (nbits < 32) fill();
+    }
+
+    inline uint32_t peek(int n) { return (uint32_t)(acc >> (64 - n)); }
+
+    inline void skip(int n)
+    {
+        acc <<= n;
+        nbits -= n;
+    }
+
+    inline int getBits(int n)
+    {
+        if (n == 0) return 0;
+        int v = (int)peek(n);
+        skip(n);
+        return v;
+    }
+
+    // 跳过RSTn标记并清空位缓冲区
+    bool restart(void)
+    {
+        acc = 0;
+        nbits = 0;
+        marker = false;
+        zeros = 0;
+        while (p < end && *p == 0xFF) {
+            if (p + 1 < end && p[1] >= 0xD0 && p[1] <= 0xD7) {
+                p += 2;
+                return true;
+            }
+            p++;
+        }
+        return false;
+    }
+
+    // 调用前需要refill()
+    inline int decode(const JpegHuffTable& t)
+    {
+        uint16_t e = t.lookup[peek(JPEG_LOOKUP_BITS)];
+        if (e >> 8) {
+            skip(e >> 8);
+            return e & 0xFF;
+        }
+        for (int l = JPEG_LOOKUP_BITS + 1; l <= 16; l++) {
+            int32_t code = (int32_t)peek(l);
+            if (code <= t.maxcode[l]) {
+                skip(l);
+                return t.vals[t.valptr[l] + code - t.mincode[l]];
+            }
+        }
+        return -1;
+    }
+};
+
+static inline int extend(int v, int s)
+{
+    return v < (1 << (s - 1)) ? v - (1 << s) + 1 : v;
+}
+
+bool JpegScan::decode(JpegBlockVisitor& visitor)
+{
+    JpegBitReader r;
+    r.p = data + scanStart;
+    r.end = data + len;
+    r.acc = 0;
+    r.nbits = 0;
+    r.marker = false;
+    r.zeros = 0;
+
+    int pred[JPEG_MAX_COMPONENTS] = { 0 };
+    int16_t zz[64];
+    int restartsLeft = restartInterval;
+
+    for (int my = 0; my < mcusY; my++) {
+        for (int mx = 0; mx < mcusX; mx++) {
+            if (restartInterval) {
+                if (restartsLeft == 0) {
+                    if (!r.restart()) return false;
+                    memset(pred, 0, sizeof(pred));
+                    restartsLeft = restartInterval;
+                }
+                restartsLeft--;
+            }
+
+            for (int c = 0; c < ncomp; c++) {
+                const JpegHuffTable& dct = dc[comp[c].td];
+                const JpegHuffTable& act = ac[comp[c].ta];
+
+                for (int v = 0; v < comp[c].v; v++) {
+                    for (int h = 0; h < comp[c].h; h++) {
+                        memset(zz, 0, sizeof(zz));
+
+                        r.refill();
+                        int s = r.decode(dct);
+                        if (s < 0 || s > 11) return false;
+                        pred[c] += s ? extend(r.getBits(s), s) : 0;
+                        zz[0] = (int16_t)pred[c];
+
+                        for (int k = 1; k < 64; k++) {
+                            r.refill();
+                            int rs = r.decode(act);
+                            if (rs < 0) return false;
+                            int run = rs >> 4;
+                            s = rs & 15;
+                            if (s == 0) {
+                                if (run != 15) break;  // EOB
+                                k += 15;                // ZRL
+                                continue;
+                            }
+                            k += run;
+                            if (k > 63) return false;
+                            zz[k] = (int16_t)extend(r.getBits(s), s);
+                        }
+
+                        // 数据被截断，解码的只是补充的0
+                        if (r.zeros > 8) return false;
+
+                        if (!visitor.block(c, mx * comp[c].h + h, my * comp[c].v + v, zz))
+                            return true;
+                    }
+                }
+            }
+        }
+    }
+    return true;
+}
+
+// ==== 重新编码 ==================================================
+
+bool jpegEncodeBlock(JpegBitWriter& w, const int16_t* zz, int* pred,
+                     const JpegHuffTable& dc, const JpegHuffTable& ac,
+                     uint32_t* dcFreq, uint32_t* acFreq)
+{
+    int diff = zz[0] - *pred;
+    *pred = zz[0];
+
+    int nb = jpegBitLength(diff);
+    if (dcFreq) dcFreq[nb]++;
+    if (dc.size[nb] == 0) return false;
+    w.putBits(dc.code[nb], dc.size[nb]);
+    if (nb) w.putBits(diff < 0 ? diff - 1 : diff, nb);
+
+    int run = 0;
+    for (int k = 1; k < 64; k++) {
+        int v = zz[k];
+        if (v == 0) {
+            run++;
+            continue;
+        }
+        while (run > 15) {
+            if (acFreq) acFreq[0xF0]++;
+            if (ac.size[0xF0] == 0) return false;
+            w.putBits(ac.code[0xF0], ac.size[0xF0]);
+            run -= 16;
+        }
+        nb = jpegBitLength(v);
+        int sym = (run << 4) | nb;
+        if (acFreq) acFreq[sym]++;
+        if (ac.size[sym] == 0) return false;
+        w.putBits(ac.code[sym], ac.size[sym]);
+        w.putBits(v < 0 ? v - 1 : v, nb);
+        run = 0;
+    }
+    if (run > 0) {
+        if (acFreq) acFreq[0x00]++;
+        if (ac.size[0x00] == 0) return false;
+        w.putBits(ac.code[0x00], ac.size[0x00]);
+    }
+    return true;
+}
+
+void jpegWriteHeaders(JpegBitWriter& w, const JpegScan& scan, int width, int height,
+                      const uint8_t* dht, size_t dhtLen)
+{
+    w.putByte(0xFF);
+    w.putByte(0xD8);
+
+    for (int i = 0; i < scan.nsegs; i++) {
+        const JpegSegment& seg = scan.segs[i];
+        if (seg.marker == 0xDD) continue;
+        if (seg.marker == 0xC4 && dht != NULL) continue;
+        if (seg.marker == 0xDA && dht != NULL) w.putBytes(dht, dhtLen);
+
+        size_t start = w.length();
+        w.putBytes(scan.data + seg.pos, seg.len);
+        if (w.overflow()) return;
+
+        // SOF: FF Cx Lh Ll P Yh Yl Xh Xl ...
+        if (seg.marker == 0xC0 || seg.marker == 0xC1) {
+            uint8_t* p = w.buffer() + start;
+            p[5] = (uint8_t)(height >> 8);
+            p[6] = (uint8_t)height;
+            p[7] = (uint8_t)(width >> 8);
+            p[8] = (uint8_t)width;
+        }
+    }
+}
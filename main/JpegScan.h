@@ -0,0 +1,135 @@
+#ifndef JPEGSCAN_H_
+#define JPEGSCAN_H_
+
+#include <stdint.h>
+#include <stddef.h>
+
+// 基线JPEG的熵编码层：解析文件头、逐块解码Huffman数据、重新编码块。
+// 只处理系数，不做IDCT，供裁剪等"JPEG域"操作使用。
+// 支持：8位精度的顺序Huffman编码（SOF0/SOF1），单个交错扫描，可选DRI。
+
+#define JPEG_MAX_COMPONENTS 3
+#define JPEG_MAX_SEGMENTS 32
+#define JPEG_LOOKUP_BITS 9
+
+// Huffman表，同时包含解码和编码所需的数据
+struct JpegHuffTable {
+    bool present;
+    uint8_t bits[17];      // bits[l]：长度为l的码字个数（l = 1..16）
+    uint8_t vals[256];     // 按码长排序的符号
+    // 解码用
+    int32_t maxcode[18];
+    int32_t valptr[17];
+    int32_t mincode[17];
+    uint16_t lookup[1 << JPEG_LOOKUP_BITS];  // (码长 << 8) | 符号，码长为0时走慢速路径
+    // 编码用
+    uint16_t code[256];
+    uint8_t size[256];     // 0 表示该符号不在表中
+};
+
+// 根据 bits/vals 生成解码和编码表，表无效时返回false
+bool jpegBuildHuffTable(JpegHuffTable* t);
+
+// SOS之前（含SOS）的一个标记段
+struct JpegSegment {
+    uint8_t marker;
+    size_t pos;            // 0xFF的偏移
+    size_t len;            // 包括标记本身的总长度
+};
+
+struct JpegComponent {
+    uint8_t id;
+    uint8_t h, v;          // 采样因子
+    uint8_t tq;            // 量化表号
+    uint8_t td, ta;        // DC/AC Huffman表号
+};
+
+// 带字节填充的输出缓冲区，写满后置溢出标志而不是越界
+class JpegBitWriter
+{
+public:
+    JpegBitWriter(uint8_t* buf, size_t cap);
+
+    void putByte(uint8_t b);
+    void putBytes(const uint8_t* p, size_t n);
+    void putBits(uint32_t bits, int size);  // 熵编码数据，0xFF后自动插入0x00
+    void flushBits();                       // 用1填充到字节边界
+
+    uint8_t* buffer(void) { return _buf; }
+    size_t length(void) { return _len; }
+    bool overflow(void) { return _overflow; }
+
+private:
+    uint8_t* _buf;
+    size_t _cap;
+    size_t _len;
+    bool _overflow;
+    uint32_t _acc;
+    int _nbits;
+};
+
+// 解码回调：按扫描顺序对每个块调用一次。
+// zz 为Z字形顺序的64个系数，zz[0]是已加上预测值的DC绝对值。返回false停止解码。
+class JpegBlockVisitor
+{
+public:
+    virtual ~JpegBlockVisitor() {}
+    virtual bool block(int comp, int bx, int by, const int16_t* zz) = 0;
+};
+
+// 带有全部Huffman表，约19KB，任务栈放不下：用create()在堆上分配，用完delete
+class JpegScan
+{
+public:
+    // 分配失败时返回NULL
+    static JpegScan* create(void);
+
+    // 解析到扫描数据开始处。不复制数据，data必须在使用期间保持有效
+    bool parse(const uint8_t* data, size_t len);
+
+    // 解码整个扫描（或直到visitor返回false）
+    bool decode(JpegBlockVisitor& visitor);
+
+    int mcuWidth(void) { return 8 * hmax; }
+    int mcuHeight(void) { return 8 * vmax; }
+
+    const uint8_t* data;
+    size_t len;
+
+    int width, height;
+    int ncomp;
+    JpegComponent comp[JPEG_MAX_COMPONENTS];
+    int hmax, vmax;
+    int mcusX, mcusY;        // 水平/垂直方向的MCU数
+    int restartInterval;     // 0 表示没有DRI
+
+    JpegSegment segs[JPEG_MAX_SEGMENTS];
+    int nsegs;
+    size_t scanStart;        // 熵编码数据的起始偏移（紧随SOS段）
+
+    uint16_t qt[4][64];      // 量化表，Z字形顺序
+    JpegHuffTable dc[4];
+    JpegHuffTable ac[4];
+};
+
+// 数值v所需的位数（JPEG中的"类别"）
+static inline int jpegBitLength(int v)
+{
+    // Xtensa上 __builtin_clz 是一条NSAU指令
+    if (v < 0) v = -v;
+    return v ? 32 - __builtin_clz(v) : 0;
+}
+
+// 用给定的表编码一个块，*pred为该分量的DC预测值（会被更新）。
+// dcFreq/acFreq不为NULL时同时统计用到的每个符号（各256项）。
+// 若需要的符号不在表中返回false
+bool jpegEncodeBlock(JpegBitWriter& w, const int16_t* zz, int* pred,
+                     const JpegHuffTable& dc, const JpegHuffTable& ac,
+                     uint32_t* dcFreq = NULL, uint32_t* acFreq = NULL);
+
+// 复制扫描数据之前的所有文件头到w，去掉DRI并把SOF中的尺寸改为width x height。
+// dht不为NULL时用它替换原有的所有DHT段
+void jpegWriteHeaders(JpegBitWriter& w, const JpegScan& scan, int width, int height,
+                      const uint8_t* dht = NULL, size_t dhtLen = 0);
+
+#endif //JPEGSCAN_H_
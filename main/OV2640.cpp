@@ -196,12 +196,16 @@ void OV2640::runIfNeeded(void)
 int OV2640::getWidth(void)
 {
     runIfNeeded();
+    if (!fb)
+        return 0;
     return fb->width;
 }
 
 int OV2640::getHeight(void)
 {
     runIfNeeded();
+    if (!fb)
+        return 0;
     return fb->height;
 }
 
@@ -227,9 +231,9 @@ framesize_t OV2640::getFrameSize(void)
     return _cam_config.frame_size;
 }
 
-void OV2640::setFrameSize(framesize_t size)
+esp_err_t OV2640::setFrameSize(framesize_t size)
 {
-    _cam_config.frame_size = size;
+    return reconfigure(size, _cam_config.pixel_format, _cam_config.jpeg_quality, _cam_config.xclk_freq_hz);
 }
 
 pixformat_t OV2640::getPixelFormat(void)
@@ -237,7 +241,7 @@ pixformat_t OV2640::getPixelFormat(void)
     return _cam_config.pixel_format;
 }
 
-void OV2640::setPixelFormat(pixformat_t format)
+esp_err_t OV2640::setPixelFormat(pixformat_t format)
 {
     switch (format)
     {
@@ -245,12 +249,155 @@ void OV2640::setPixelFormat(pixformat_t format)
     case PIXFORMAT_YUV422:
     case PIXFORMAT_GRAYSCALE:
     case PIXFORMAT_JPEG:
-        _cam_config.pixel_format = format;
         break;
     default:
-        _cam_config.pixel_format = PIXFORMAT_GRAYSCALE;
+        format = PIXFORMAT_GRAYSCALE;
         break;
     }
+    return reconfigure(_cam_config.frame_size, format, _cam_config.jpeg_quality, _cam_config.xclk_freq_hz);
+}
+
+int OV2640::getQuality(void)
+{
+    return _cam_config.jpeg_quality;
+}
+
+esp_err_t OV2640::setQuality(int quality)
+{
+    return reconfigure(_cam_config.frame_size, _cam_config.pixel_format, quality, _cam_config.xclk_freq_hz);
+}
+
+int OV2640::getXclk(void)
+{
+    return _cam_config.xclk_freq_hz;
+}
+
+esp_err_t OV2640::setXclk(int xclkHz)
+{
+    return reconfigure(_cam_config.frame_size, _cam_config.pixel_format, _cam_config.jpeg_quality, xclkHz);
+}
+
+// 驱动在初始化时按格式和尺寸分配帧缓冲区并设置DMA，只有这些还适用时才能只改传感器
+bool OV2640::needsReinit(framesize_t size, pixformat_t format)
+{
+    pixformat_t cur = _cam_config.pixel_format;
+    if (format != cur)
+    {
+        // RGB565和YUV422每像素都是2字节，帧长度和DMA设置不变
+        bool twoBytes = (format == PIXFORMAT_RGB565 || format == PIXFORMAT_YUV422) &&
+                        (cur == PIXFORMAT_RGB565 || cur == PIXFORMAT_YUV422);
+        if (!twoBytes)
+            return true;
+    }
+    if (size == _cam_config.frame_size)
+        return false;
+
+    // 原始格式的帧长度在初始化时就固定了
+    if (format != PIXFORMAT_JPEG)
+        return true;
+
+    // JPEG缓冲区按初始化时的尺寸分配，不超过它的尺寸都放得下
+    const resolution_info_t& to = resolution[size];
+    const resolution_info_t& max = resolution[_init_frame_size];
+    return (uint32_t)to.width * to.height > (uint32_t)max.width * max.height;
+}
+
+esp_err_t OV2640::reconfigure(framesize_t size, pixformat_t format, int quality, int xclkHz, bool* reinit)
+{
+    if (size >= FRAMESIZE_INVALID)
+        return ESP_ERR_INVALID_ARG;
+
+    // 先把持有的帧还给驱动：重新初始化会释放所有帧缓冲区
+    if (fb)
+    {
+        esp_camera_fb_return(fb);
+        fb = NULL;
+    }
+
+    bool full = needsReinit(size, format);
+    if (reinit)
+        *reinit = full;
+
+    if (full)
+    {
+        camera_config_t old = _cam_config;
+        _cam_config.frame_size = size;
+        _cam_config.pixel_format = format;
+        _cam_config.jpeg_quality = quality;
+        _cam_config.xclk_freq_hz = xclkHz;
+
+        esp_camera_deinit();
+        esp_err_t err = esp_camera_init(&_cam_config);
+        if (err != ESP_OK)
+        {
+            // 新配置不被接受时恢复原来的配置，摄像头继续工作
+            printf("Camera reconfigure failed with error 0x%x, restoring\n", err);
+            _cam_config = old;
+            if (esp_camera_init(&_cam_config) != ESP_OK)
+                printf("Camera restore failed\n");
+            return err;
+        }
+        _init_frame_size = size;
+        return ESP_OK;
+    }
+
+    sensor_t *s = esp_camera_sensor_get();
+    if (!s)
+        return ESP_FAIL;
+
+    // 逐项设置，已经成功的项立即记录，失败时配置与传感器保持一致
+    esp_err_t err = ESP_OK;
+    bool layoutChanged = false;
+    if (format != _cam_config.pixel_format)
+    {
+        if (s->set_pixformat(s, format) != 0)
+            err = ESP_FAIL;
+        else
+        {
+            _cam_config.pixel_format = format;
+            layoutChanged = true;
+        }
+    }
+    if (err == ESP_OK && size != _cam_config.frame_size)
+    {
+        if (s->set_framesize(s, size) != 0)
+            err = ESP_FAIL;
+        else
+        {
+            _cam_config.frame_size = size;
+            layoutChanged = true;
+        }
+    }
+    if (err == ESP_OK && quality != _cam_config.jpeg_quality)
+    {
+        if (s->set_quality(s, quality) != 0)
+            err = ESP_FAIL;
+        else
+            _cam_config.jpeg_quality = quality;
+    }
+    if (err == ESP_OK && xclkHz != _cam_config.xclk_freq_hz)
+    {
+        if (s->set_xclk(s, _cam_config.ledc_timer, xclkHz / 1000000) != 0)
+            err = ESP_FAIL;
+        else
+            _cam_config.xclk_freq_hz = xclkHz;
+    }
+
+    // 格式或尺寸变了：驱动中已经排队的帧是按旧设置采集的，
+    // 不丢弃的话会被当作新格式的帧交给调用方
+    if (layoutChanged)
+        dropQueuedFrames();
+    return err;
+}
+
+void OV2640::dropQueuedFrames(void)
+{
+    for (size_t i = 0; i < _cam_config.fb_count; i++)
+    {
+        camera_fb_t *f = esp_camera_fb_get();
+        if (f)
+            esp_camera_fb_return(f);
+    }
 }
 
 esp_err_t OV2640::init(camera_config_t config)
@@ -264,6 +411,7 @@ esp_err_t OV2640::init(camera_config_t config)
         printf("Camera probe failed with error 0x%x", err);
         return err;
     }
+    _init_frame_size = _cam_config.frame_size;
     // ESP_ERROR_CHECK(gpio_install_isr_service(0));
 
     return ESP_OK;
@@ -45,16 +45,29 @@ public:
     framesize_t getFrameSize(void);
     pixformat_t getPixelFormat(void);
 
-    // 设置帧属性
-    void setFrameSize(framesize_t size);
-    void setPixelFormat(pixformat_t format);
+    int getQuality(void);
+    int getXclk(void);
+
+    // 设置帧属性，立即应用到传感器（见 reconfigure）
+    esp_err_t setFrameSize(framesize_t size);
+    esp_err_t setPixelFormat(pixformat_t format);
+    esp_err_t setQuality(int quality);
+    esp_err_t setXclk(int xclkHz);
+
+    // 运行时重新配置。能只改传感器寄存器时通过sensor_t直接设置；
+    // 驱动的帧缓冲区放不下新的格式或尺寸时才重新初始化驱动，reinit 返回是否这样做了。
+    // 调用方必须保证此时没有其他任务在使用摄像头
+    esp_err_t reconfigure(framesize_t size, pixformat_t format, int quality, int xclkHz, bool* reinit = NULL);
 
 private:
     void runIfNeeded(); // 如果我们还没有帧，则抓取一帧
+    bool needsReinit(framesize_t size, pixformat_t format);
+    void dropQueuedFrames(void); // 丢弃驱动中按旧设置采集的帧
 
     // camera_framesize_t _frame_size;
     // camera_pixelformat_t _pixel_format;
     camera_config_t _cam_config;
+    framesize_t _init_frame_size; // 驱动按此尺寸分配了帧缓冲区
 
     camera_fb_t *fb;
 };
@@ -0,0 +1,18 @@
+#ifndef PUSHPROTOCOL_H_
+#define PUSHPROTOCOL_H_
+
+#include <stdint.h>
+
+// 推流模式的帧格式，设备与 tools/relay 共用。
+// 设备通过一个持久的TCP连接向中继发送连续的帧：16字节小端帧头，紧跟JPEG数据。
+#define PUSH_FRAME_MAGIC 0x47504A4D  // "MJPG"
+#define PUSH_MAX_FRAME   (4 * 1024 * 1024)
+
+struct __attribute__((packed)) PushFrameHeader {
+    uint32_t magic;      // PUSH_FRAME_MAGIC
+    uint32_t seq;        // 帧序号，跳号表示设备端丢弃了帧
+    uint32_t timestamp;  // 帧捕获时间，设备开机以来的毫秒数
+    uint32_t length;     // 随后JPEG数据的字节数
+};
+
+#endif //PUSHPROTOCOL_H_
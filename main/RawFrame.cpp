@@ -0,0 +1,127 @@
+#include "RawFrame.h"
+
+static RawPixelFormat rawFormatOf(pixformat_t format)
+{
+    switch (format)
+    {
+    case PIXFORMAT_RGB565:
+        return RAW_FMT_RGB565;
+    case PIXFORMAT_YUV422:
+        return RAW_FMT_YUV422;
+    default:
+        return RAW_FMT_GRAY8;
+    }
+}
+
+static int rawBytesPerPixel(RawPixelFormat format)
+{
+    return format == RAW_FMT_GRAY8 ? 1 : 2;
+}
+
+bool rawSupported(pixformat_t format)
+{
+    return format == PIXFORMAT_RGB565 ||
+           format == PIXFORMAT_YUV422 ||
+           format == PIXFORMAT_GRAYSCALE;
+}
+
+bool rawIsIdentity(pixformat_t format, const RawOptions& opt)
+{
+    return opt.scale == 1 && (!opt.gray || format == PIXFORMAT_GRAYSCALE);
+}
+
+size_t rawOutputSize(int width, int height, pixformat_t format, const RawOptions& opt,
+                     int* outWidth, int* outHeight, RawPixelFormat* outFormat)
+{
+    RawPixelFormat f = opt.gray ? RAW_FMT_GRAY8 : rawFormatOf(format);
+    int w = width / opt.scale;
+    int h = height / opt.scale;
+
+    // YUYV 以像素对为单位，宽度必须是偶数
+    if (f == RAW_FMT_YUV422) w &= ~1;
+
+    *outWidth = w;
+    *outHeight = h;
+    *outFormat = f;
+    return (size_t)w * h * rawBytesPerPixel(f);
+}
+
+// RGB565（高字节在前）转 8 位亮度，BT.601 系数的定点近似
+static inline uint8_t rgb565ToGray(const uint8_t* p)
+{
+    uint8_t r = p[0] & 0xF8;
+    uint8_t g = ((p[0] & 0x07) << 5) | ((p[1] >> 3) & 0x1C);
+    uint8_t b = (p[1] & 0x1F) << 3;
+    return (uint8_t)((r * 77 + g * 150 + b * 29) >> 8);
+}
+
+size_t rawConvert(const uint8_t* src, int width, int height, pixformat_t format,
+                  const RawOptions& opt, uint8_t* dst)
+{
+    int w, h;
+    RawPixelFormat f;
+    size_t len = rawOutputSize(width, height, format, opt, &w, &h, &f);
+    const int s = opt.scale;
+    uint8_t* d = dst;
+
+    for (int y = 0; y < h; y++) {
+        const uint8_t* row = src + (size_t)y * s * width * (format == PIXFORMAT_GRAYSCALE ? 1 : 2);
+
+        switch (format)
+        {
+        case PIXFORMAT_GRAYSCALE:
+            for (int x = 0; x < w; x++) *d++ = row[x * s];
+            break;
+
+        case PIXFORMAT_RGB565:
+            if (f == RAW_FMT_GRAY8) {
+                for (int x = 0; x < w; x++) *d++ = rgb565ToGray(row + x * s * 2);
+            }
+            else {
+                for (int x = 0; x < w; x++) {
+                    const uint8_t* p = row + x * s * 2;
+                    *d++ = p[0];
+                    *d++ = p[1];
+                }
+            }
+            break;
+
+        case PIXFORMAT_YUV422:
+            if (f == RAW_FMT_GRAY8) {
+                // YUYV 中亮度位于偶数字节
+                for (int x = 0; x < w; x++) *d++ = row[x * s * 2];
+            }
+            else {
+                // 每个输出像素对取源像素对的色度，亮度各自取样
+                for (int x = 0; x < w; x += 2) {
+                    const uint8_t* p0 = row + x * s * 2;
+                    const uint8_t* p1 = row + (x + 1) * s * 2;
+                    const uint8_t* pair = row + ((x * s) & ~1) * 2;
+                    *d++ = p0[0];
+                    *d++ = pair[1];
+                    *d++ = p1[0];
+                    *d++ = pair[3];
+                }
+            }
+            break;
+
+        default:
+            return 0;
+        }
+    }
+    return len;
+}
+
+void rawFillHeader(RawFrameHeader* hdr, int width, int height, RawPixelFormat format,
+                   uint32_t timestamp, uint32_t seq, size_t length)
+{
+    hdr->magic = RAW_FRAME_MAGIC;
+    hdr->width = (uint16_t)width;
+    hdr->height = (uint16_t)height;
+    hdr->format = format;
+    hdr->bpp = (uint8_t)rawBytesPerPixel(format);
+    hdr->reserved = 0;
+    hdr->timestamp = timestamp;
+    hdr->seq = seq;
+    hdr->length = (uint32_t)length;
+}
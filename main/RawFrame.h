@@ -0,0 +1,55 @@
+#ifndef RAWFRAME_H_
+#define RAWFRAME_H_
+
+#include <stdint.h>
+#include <stddef.h>
+#include "esp_camera.h"
+
+// /raw 流中每帧前面的二进制帧头（小端序，共24字节）
+// 客户端先读取帧头，再按 length 读取像素数据
+#define RAW_FRAME_MAGIC 0x46574152  // "RAWF"
+
+// 帧头中的像素格式代码（与 pixformat_t 无关，作为协议的一部分保持稳定）
+enum RawPixelFormat : uint8_t {
+    RAW_FMT_GRAY8  = 0,  // 每像素1字节
+    RAW_FMT_RGB565 = 1,  // 每像素2字节，高字节在前（与传感器输出一致）
+    RAW_FMT_YUV422 = 2   // YUYV，每像素2字节
+};
+
+struct __attribute__((packed)) RawFrameHeader {
+    uint32_t magic;      // RAW_FRAME_MAGIC
+    uint16_t width;
+    uint16_t height;
+    uint8_t  format;     // RawPixelFormat
+    uint8_t  bpp;        // 每像素字节数
+    uint16_t reserved;
+    uint32_t timestamp;  // 帧捕获时间，开机以来的毫秒数
+    uint32_t seq;        // 帧序号，客户端可据此发现丢帧
+    uint32_t length;     // 紧随帧头的像素数据字节数
+};
+
+// 客户端请求的输出变换
+struct RawOptions {
+    int scale;   // 1, 2, 4 或 8 - 最近邻降采样因子
+    bool gray;   // 是否输出灰度
+};
+
+// 传感器格式是否可以直接以原始像素流式传输
+bool rawSupported(pixformat_t format);
+
+// 变换后的输出是否与源帧完全相同（此时可以零拷贝发送 camBuf）
+bool rawIsIdentity(pixformat_t format, const RawOptions& opt);
+
+// 计算变换后的尺寸和格式，返回所需的输出缓冲区大小
+size_t rawOutputSize(int width, int height, pixformat_t format, const RawOptions& opt,
+                     int* outWidth, int* outHeight, RawPixelFormat* outFormat);
+
+// 将源帧降采样/转换为灰度后写入 dst，返回写入的字节数
+size_t rawConvert(const uint8_t* src, int width, int height, pixformat_t format,
+                  const RawOptions& opt, uint8_t* dst);
+
+// 填充帧头
+void rawFillHeader(RawFrameHeader* hdr, int width, int height, RawPixelFormat format,
+                   uint32_t timestamp, uint32_t seq, size_t length);
+
+#endif //RAWFRAME_H_
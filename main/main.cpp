@@ -1,9 +1,15 @@
 #include "Arduino.h"
 #include "esp_camera.h"
 #include "OV2640.h"
+#include "RawFrame.h"
+#include "JpegCrop.h"
+#include "JpegPreview.h"
+#include "JpegHuffOpt.h"
+#include "PushProtocol.h"
 #include <WiFi.h>
 #include <WebServer.h>
 #include <WiFiClient.h>
+#include <new>
 
 // ESP-IDF特定头文件
 #include "esp_log.h"
@@ -24,6 +30,19 @@
 // WiFi凭据
 #include "home_wifi_multi.h"
 
+// 推流模式：在 home_wifi_multi.h 中定义 PUSH_HOST 即可启用
+#ifdef PUSH_HOST
+#ifndef PUSH_PORT
+#define PUSH_PORT 8081
+#endif
+#endif
+
+// 场景自适应Huffman表优化：无损，帧通常小5-15%，代价是每帧多一次熵编码。
+// 在 home_wifi_multi.h 中定义 HUFF_OPTIMIZE 为1即可启用
+#ifndef HUFF_OPTIMIZE
+#define HUFF_OPTIMIZE 0
+#endif
+
 // 日志标签
 static const char* TAG = "ESP32_CAM";
 
@@ -34,6 +53,7 @@ WebServer server(80);
 TaskHandle_t tMjpeg;   // 处理到webserver的客户端连接
 TaskHandle_t tCam;     // 处理从摄像头获取图片帧并本地存储
 TaskHandle_t tStream;  // 实际向所有连接的客户端流式传输帧
+TaskHandle_t tPush;    // 推流模式：向中继服务器上传帧
 
 // frameSync信号量用于防止在更换下一帧时流式传输缓冲区
 SemaphoreHandle_t frameSync = NULL;
@@ -41,6 +61,23 @@ SemaphoreHandle_t frameSync = NULL;
 // 队列存储当前连接的正在流式传输的客户端
 QueueHandle_t streamingClients;
 
+// 流客户端的类型
+enum StreamKind {
+  STREAM_MJPEG,   // /mjpeg/1 - multipart JPEG
+  STREAM_RAW,     // /raw - 带二进制帧头的未压缩像素
+  STREAM_PREVIEW  // /mjpeg/preview - 1/8比例的缩略图MJPEG
+};
+
+// 队列中的每个条目：客户端连接及其请求的流参数
+struct StreamClient {
+  WiFiClient client;
+  StreamKind kind;
+  RawOptions raw;      // 仅用于 STREAM_RAW
+  bool crop;           // 仅用于 STREAM_MJPEG：是否只发送感兴趣区域
+  JpegRect roi;
+  uint32_t lastSeq;    // 最后发送给此客户端的帧序号
+};
+
 // 我们将尝试实现25 FPS的帧率
 const int FPS = 14;
 
@@ -50,13 +87,41 @@ const int WSINTERVAL = 100;
 // 常用变量：
 volatile size_t camSize;    // 当前帧的大小，字节
 volatile char* camBuf;      // 指向当前帧的指针
+volatile int camWidth;      // 当前帧的宽度
+volatile int camHeight;     // 当前帧的高度
+volatile pixformat_t camFormat; // 当前帧的像素格式，重新配置后可能与传感器当前的格式不同
+volatile uint32_t camSeq;   // 当前帧的序号，每帧递增
+volatile uint32_t camStamp; // 当前帧的捕获时间，毫秒
+
+// 推流连接已建立时，即使没有本地客户端摄像头也要保持运行
+volatile bool pushActive = false;
+
+// /control 请求的新配置，由抓帧任务在两帧之间应用
+struct CamControl {
+  framesize_t size;
+  pixformat_t format;
+  int quality;
+  int xclk;            // Hz
+  esp_err_t result;
+  bool reinit;         // 是否重新初始化了驱动
+  uint32_t applyUs;    // 重新配置本身占用的时间，即抓帧暂停的时间
+  uint32_t stackFree;  // 重新配置后抓帧任务堆栈的历史最小剩余量（字节）
+};
+CamControl* volatile camControl = NULL;   // 等待应用的请求
+SemaphoreHandle_t controlDone = NULL;
 
 // 前向声明
 void camCB(void* pvParameters);
 void streamCB(void* pvParameters);
 void handleJPGSstream(void);
+void handleRawStream(void);
+void handlePreviewStream(void);
 void handleJPG(void);
+void handleControl(void);
 void handleNotFound(void);
+#ifdef PUSH_HOST
+void pushCB(void* pvParameters);
+#endif
 
 // ==== 内存分配器，如果存在PSRAM则利用它 =======================
 char* allocateMemory(char* aPtr, size_t aSize) {
@@ -99,15 +164,19 @@ void mjpegCB(void* pvParameters) {
   xSemaphoreGive(frameSync);
 
   // 创建一个队列来跟踪所有连接的客户端
-  streamingClients = xQueueCreate(10, sizeof(WiFiClient*));
+  streamingClients = xQueueCreate(10, sizeof(StreamClient*));
+
+  // 抓帧任务完成重新配置后通知 /control
+  controlDone = xSemaphoreCreateBinary();
 
   //=== 设置部分 ==================
 
   // 创建用于从摄像头抓取帧的RTOS任务
+  // /control 重新初始化驱动（esp_camera_deinit/init）也在这个任务中进行，堆栈要留足
   xTaskCreatePinnedToCore(
     camCB,       // 回调
     "cam",       // 名称
-    4096,        // 堆栈大小
+    8 * 1024,    // 堆栈大小
     NULL,        // 参数
     2,           // 优先级
     &tCam,       // RTOS任务句柄
@@ -123,9 +192,24 @@ void mjpegCB(void* pvParameters) {
     &tStream,
     APP_CPU);
 
+#ifdef PUSH_HOST
+  // 创建向中继服务器推流的任务
+  xTaskCreatePinnedToCore(
+    pushCB,
+    "push",
+    4 * 1024,
+    NULL,
+    2,
+    &tPush,
+    APP_CPU);
+#endif
+
   // 注册webserver处理例程
   server.on("/mjpeg/1", HTTP_GET, handleJPGSstream);
+  server.on("/raw", HTTP_GET, handleRawStream);
+  server.on("/mjpeg/preview", HTTP_GET, handlePreviewStream);
   server.on("/jpg", HTTP_GET, handleJPG);
+  server.on("/control", HTTP_GET, handleControl);
   server.onNotFound(handleNotFound);
 
   // 启动webserver
@@ -142,6 +226,14 @@ void mjpegCB(void* pvParameters) {
   }
 }
 
+// ==== 应用新的摄像头配置（调用方保证此时没有任务在抓帧） ==========
+void applyCamControl(CamControl* c) {
+  uint32_t t0 = micros();
+  c->result = cam.reconfigure(c->size, c->format, c->quality, c->xclk, &c->reinit);
+  c->applyUs = micros() - t0;
+  c->stackFree = uxTaskGetStackHighWaterMark(NULL);
+}
+
 // ==== RTOS任务从摄像头抓取帧 =========================
 void camCB(void* pvParameters) {
   TickType_t xLastWakeTime;
@@ -161,9 +253,20 @@ void camCB(void* pvParameters) {
   xLastWakeTime = xTaskGetTickCount();
 
   for (;;) {
+    // 在两帧之间执行等待中的重新配置请求，此时本任务不持有frameSync
+    if (camControl != NULL) {
+      applyCamControl(camControl);
+      camControl = NULL;
+      xSemaphoreGive(controlDone);
+    }
+
     // 从摄像头抓取一帧并查询其大小
     cam.run();
     size_t s = cam.getSize();
+    int w = cam.getWidth();
+    int h = cam.getHeight();
+    pixformat_t f = cam.getPixelFormat();
+    uint32_t stamp = millis();
 
     // 如果帧大小比我们之前分配的更多 - 请求当前帧空间的125%
     if (s > fSize[ifb]) {
@@ -187,6 +290,11 @@ void camCB(void* pvParameters) {
     portENTER_CRITICAL(&xSemaphore);
     camBuf = fbs[ifb];
     camSize = s;
+    camWidth = w;
+    camHeight = h;
+    camFormat = f;
+    camStamp = stamp;
+    camSeq++;
     ifb++;
     ifb &= 1;  // 这应该产生1, 0, 1, 0, 1 ...序列
     portEXIT_CRITICAL(&xSemaphore);
@@ -201,9 +309,9 @@ void camCB(void* pvParameters) {
     // 立即让其他（流式传输）任务运行
     taskYIELD();
 
-    // 如果流式传输任务已挂起自己（没有要流式传输的活动客户端）
+    // 如果流式传输任务已挂起自己（没有要流式传输的活动客户端）且没有推流，
     // 则无需从摄像头抓取帧。我们可以通过挂起任务来节省一些功耗
-    if (eTaskGetState(tStream) == eSuspended) {
+    if (eTaskGetState(tStream) == eSuspended && !pushActive) {
       vTaskSuspend(NULL);  // 传递NULL表示"挂起自己"
     }
   }
@@ -219,30 +327,411 @@ const int hdrLen = strlen(HEADER);
 const int bdrLen = strlen(BOUNDARY);
 const int cntLen = strlen(CTNTTYPE);
 
+const char RAWHEADER[] = "HTTP/1.1 200 OK\r\n" \
+                       "Access-Control-Allow-Origin: *\r\n" \
+                       "Content-Type: application/octet-stream\r\n" \
+                       "Cache-Control: no-cache\r\n\r\n";
+const int rawhdLen = strlen(RAWHEADER);
+
+// 将新的流客户端加入队列并唤醒流任务
+void addStreamClient(StreamClient* sc) {
+  // 将客户端推到流队列
+  xQueueSend(streamingClients, (void*)&sc, 0);
+
+  // 唤醒流任务，如果它们之前被挂起：
+  if (eTaskGetState(tCam) == eSuspended) vTaskResume(tCam);
+  if (eTaskGetState(tStream) == eSuspended) vTaskResume(tStream);
+}
+
 // ==== 处理来自客户端的连接请求 ===============================
 void handleJPGSstream(void) {
   // 只能容纳10个客户端。限制是WiFi连接的默认值
   if (!uxQueueSpacesAvailable(streamingClients)) return;
 
-  // 创建一个新的WiFi客户端对象来跟踪这个
-  WiFiClient* client = new WiFiClient();
-  *client = server.client();
+  // 与 /jpg 一致：无效的裁剪区域直接拒绝，而不是静默发送完整帧
+  JpegRect roi;
+  bool crop = server.hasArg("crop");
+  if (crop && !jpegParseRect(server.arg("crop").c_str(), &roi)) {
+    server.send(400, "text/plain", "crop must be x,y,w,h\n");
+    return;
+  }
+
+  // 创建一个新的流客户端对象来跟踪这个
+  StreamClient* sc = new StreamClient();
+  sc->client = server.client();
+  sc->kind = STREAM_MJPEG;
+  sc->lastSeq = 0;
+  sc->crop = crop;
+  if (crop) sc->roi = roi;
 
   // 立即向此客户端发送标头
-  client->write(HEADER, hdrLen);
-  client->write(BOUNDARY, bdrLen);
+  sc->client.write(HEADER, hdrLen);
+  sc->client.write(BOUNDARY, bdrLen);
 
-  // 将客户端推到流队列
-  xQueueSend(streamingClients, (void*)&client, 0);
+  addStreamClient(sc);
+}
 
-  // 唤醒流任务，如果它们之前被挂起：
-  if (eTaskGetState(tCam) == eSuspended) vTaskResume(tCam);
-  if (eTaskGetState(tStream) == eSuspended) vTaskResume(tStream);
+// ==== 处理缩略图流请求 ===========================================
+void handlePreviewStream(void) {
+  if (!uxQueueSpacesAvailable(streamingClients)) return;
+
+  StreamClient* sc = new StreamClient();
+  sc->client = server.client();
+  sc->kind = STREAM_PREVIEW;
+  sc->crop = false;
+  sc->lastSeq = 0;
+
+  sc->client.write(HEADER, hdrLen);
+  sc->client.write(BOUNDARY, bdrLen);
+
+  addStreamClient(sc);
+}
+
+// ==== 处理原始像素流请求: /raw?scale=1|2|4|8&gray=0|1 ==============
+void handleRawStream(void) {
+  if (!rawSupported(cam.getPixelFormat())) {
+    server.send(415, "text/plain", "Raw stream requires a non-JPEG sensor pixel format\n");
+    return;
+  }
+  if (!uxQueueSpacesAvailable(streamingClients)) {
+    server.send(503, "text/plain", "Too many clients\n");
+    return;
+  }
+
+  RawOptions opt;
+  opt.scale = server.hasArg("scale") ? server.arg("scale").toInt() : 1;
+  opt.gray = server.hasArg("gray") && server.arg("gray").toInt() != 0;
+  if (opt.scale != 1 && opt.scale != 2 && opt.scale != 4 && opt.scale != 8) {
+    server.send(400, "text/plain", "scale must be 1, 2, 4 or 8\n");
+    return;
+  }
+
+  StreamClient* sc = new StreamClient();
+  sc->client = server.client();
+  sc->kind = STREAM_RAW;
+  sc->raw = opt;
+  sc->crop = false;
+  sc->lastSeq = 0;
+
+  sc->client.write(RAWHEADER, rawhdLen);
+
+  addStreamClient(sc);
+}
+
+// 按帧缓存的变体（裁剪区域、原始像素的降采样/灰度变换）：每帧每种变体只计算一次，
+// 所有请求相同变体的客户端共享同一个缓冲区
+const int FRAME_VARIANTS = 4;
+
+template <typename Key>
+struct FrameVariants {
+  struct Slot {
+    Key key;
+    uint32_t seq;        // 缓冲区内容对应的帧序号
+    char* buf;
+    size_t bufSize;
+    size_t len;          // 计算结果的字节数，0 表示失败
+    bool used;
+  };
+  Slot slots[FRAME_VARIANTS];
+  int next;
+
+  // 返回当前帧指定变体的槽位，必要时计算（调用方持有frameSync）。
+  // same 比较两个key；compute(buf, cap) 向至少 need 字节的缓冲区写入结果并返回字节数
+  template <typename Same, typename Compute>
+  Slot* get(const Key& key, size_t need, Same same, Compute compute) {
+    Slot* v = NULL;
+    for (int i = 0; i < FRAME_VARIANTS; i++) {
+      if (slots[i].used && same(slots[i].key, key)) {
+        v = &slots[i];
+        break;
+      }
+    }
+    if (v == NULL) {
+      // 轮流替换最早的槽位
+      v = &slots[next];
+      next = (next + 1) % FRAME_VARIANTS;
+      v->key = key;
+      v->used = true;
+      v->seq = camSeq - 1;
+    }
+
+    if (v->seq != camSeq) {
+      if (need > v->bufSize) {
+        v->bufSize = need;
+        v->buf = allocateMemory(v->buf, v->bufSize);
+      }
+      v->len = compute((uint8_t*)v->buf, v->bufSize);
+      v->seq = camSeq;
+    }
+    return v;
+  }
+};
+
+// 非JPEG格式时当前帧转换后的JPEG，每帧只转换一次，所有MJPEG客户端共享
+uint8_t* convJpg = NULL;
+size_t convSize = 0;
+uint32_t convSeq = 0;       // 最后一次尝试转换的帧序号
+bool convOk = false;        // 该帧是否转换成功
+
+// 返回传感器输出的JPEG，非JPEG格式时转换（调用方持有frameSync）。
+// 失败的结果同样记录下来，同一帧不会为每个客户端重复转换
+bool sourceJpeg(const uint8_t** jpg, size_t* jpgSize) {
+  pixformat_t format = camFormat;
+  if (format == PIXFORMAT_JPEG || camSize == 0) {
+    *jpg = (const uint8_t*)camBuf;
+    *jpgSize = camSize;
+    return true;
+  }
+
+  if (convSeq != camSeq) {
+    if (convJpg != NULL) {
+      free(convJpg);
+      convJpg = NULL;
+    }
+    convOk = fmt2jpg((uint8_t*)camBuf, camSize, camWidth, camHeight,
+                     format, 30, &convJpg, &convSize) && convSize > 0;
+    if (!convOk) {
+      ESP_LOGE(TAG, "格式转换失败，使用原始数据");
+      free(convJpg);
+      convJpg = NULL;
+    }
+    else {
+      ESP_LOGI(TAG, "格式转换为JPEG成功: %u -> %u bytes", camSize, convSize);
+    }
+    convSeq = camSeq;
+  }
+  if (!convOk) return false;
+
+  *jpg = convJpg;
+  *jpgSize = convSize;
+  return true;
+}
+
+#if HUFF_OPTIMIZE
+// 每隔多少帧用最新的符号统计重建一次Huffman表
+const int HUFF_REBUILD_FRAMES = 30;
+
+// 优化器约48KB（8张Huffman表、符号统计和JpegScan），作为全局对象会占用内部DRAM的.bss，
+// 因此在启动时分配，有PSRAM时放在PSRAM中
+JpegHuffOptimizer* huffOpt = NULL;
+
+// 当前帧优化后的JPEG，每帧只做一次，所有客户端和推流共享
+uint8_t* optJpg = NULL;
+size_t optBufSize = 0;
+size_t optSize = 0;     // 0表示本帧使用原帧
+uint32_t optSeq = 0;
+
+void optimizeJpeg(const uint8_t** jpg, size_t* jpgSize) {
+  if (*jpgSize == 0) return;
+
+  if (optJpg == NULL || optSeq != camSeq) {
+    // 新的DHT段可能比标准表略大，多留一些空间
+    size_t need = *jpgSize + 1024;
+    if (need > optBufSize) {
+      optBufSize = need * 4 / 3;
+      optJpg = (uint8_t*)allocateMemory((char*)optJpg, optBufSize);
+    }
+    optSize = huffOpt->process(*jpg, *jpgSize, optJpg, optBufSize);
+    optSeq = camSeq;
+
+    if (optSize > 0 && huffOpt->frames % 100 == 0) {
+      ESP_LOGI(TAG, "Huffman优化: %lu帧，重建表%lu次，%llu -> %llu bytes",
+               (unsigned long)huffOpt->frames, (unsigned long)huffOpt->rebuilds,
+               (unsigned long long)huffOpt->bytesIn, (unsigned long long)huffOpt->bytesOut);
+    }
+  }
+
+  if (optSize > 0) {
+    *jpg = optJpg;
+    *jpgSize = optSize;
+  }
+}
+#endif
+
+// 返回当前帧要发送的JPEG数据（调用方持有frameSync）。转换失败时返回false
+bool currentJpeg(const uint8_t** jpg, size_t* jpgSize) {
+  if (!sourceJpeg(jpg, jpgSize)) return false;
+#if HUFF_OPTIMIZE
+  optimizeJpeg(jpg, jpgSize);
+#endif
+  return true;
+}
+
+// 裁剪结果按区域缓存
+bool sameRect(const JpegRect& a, const JpegRect& b) {
+  return a.x == b.x && a.y == b.y && a.w == b.w && a.h == b.h;
+}
+FrameVariants<JpegRect> cropVariants;
+
+// 写出一个multipart分段：头部、JPEG数据和分隔符
+void writeMjpegPart(WiFiClient& client, const uint8_t* jpg, size_t jpgSize) {
+  char buf[16];
+
+  client.write(CTNTTYPE, cntLen);
+  sprintf(buf, "%u\r\n\r\n", jpgSize);
+  client.write(buf, strlen(buf));
+  client.write(jpg, jpgSize);
+  client.write(BOUNDARY, bdrLen);
+}
+
+// ==== 向一个客户端发送当前帧的MJPEG分段（调用方持有frameSync） ======
+void sendMjpegFrame(StreamClient* sc) {
+  const uint8_t* jpg;
+  size_t jpgSize;
+
+  if (!currentJpeg(&jpg, &jpgSize)) {
+    // 转换失败，发送原始数据
+    jpg = (const uint8_t*)camBuf;
+    jpgSize = camSize;
+  }
+  else if (sc->crop && jpgSize > 0) {
+    // 裁剪结果不会比原帧大太多：文件头相同，只是DC差值可能变长
+    FrameVariants<JpegRect>::Slot* v = cropVariants.get(sc->roi, jpgSize + 1024, sameRect,
+      [&](uint8_t* buf, size_t cap) {
+        size_t n = jpegCrop(jpg, jpgSize, sc->roi, buf, cap, NULL);
+        if (n == 0) ESP_LOGW(TAG, "JPEG裁剪失败，发送完整帧");
+        return n;
+      });
+    if (v->len > 0) {
+      jpg = (const uint8_t*)v->buf;
+      jpgSize = v->len;
+    }
+  }
+
+  writeMjpegPart(sc->client, jpg, jpgSize);
+}
+
+// 缩略图：每帧只生成一次，所有预览客户端共享
+char* prevPix = NULL;       // 1/8比例的像素，fmt2jpg的输入
+size_t prevPixSize = 0;
+uint8_t* prevJpg = NULL;
+size_t prevJpgSize = 0;
+uint32_t prevSeq = 0;       // 最后一次尝试生成缩略图的帧序号
+bool prevOk = false;        // 该帧的缩略图是否可用
+
+// 为当前帧生成缩略图JPEG（调用方持有frameSync）
+bool buildPreview(void) {
+  if (prevJpg != NULL) {
+    free(prevJpg);
+    prevJpg = NULL;
+  }
+  if (camSize == 0) return false;
+
+  int w, h;
+  size_t s;
+  pixformat_t format = camFormat;
+  pixformat_t prevFormat;
+
+  if (format == PIXFORMAT_JPEG) {
+    // 硬件JPEG：只解码每个8x8块的DC系数就得到1/8比例的图像。
+    // 缓冲区不够时jpegPreview给出所需的尺寸，扩大后重试，只在尺寸变大时发生
+    bool gray;
+    if (!jpegPreview((const uint8_t*)camBuf, camSize, (uint8_t*)prevPix, prevPixSize, &w, &h, &gray)) {
+      // 不受支持或缓冲区已经够大（解码出错）时不再重试
+      if (w == 0 || (size_t)w * h * (gray ? 1 : 3) <= prevPixSize) return false;
+      prevPixSize = (size_t)w * h * (gray ? 1 : 3);
+      prevPix = allocateMemory(prevPix, prevPixSize);
+      if (!jpegPreview((const uint8_t*)camBuf, camSize, (uint8_t*)prevPix, prevPixSize, &w, &h, &gray)) return false;
+    }
+    s = (size_t)w * h * (gray ? 1 : 3);
+    prevFormat = gray ? PIXFORMAT_GRAYSCALE : PIXFORMAT_RGB888;
+  }
+  else if (rawSupported(format)) {
+    // 原始像素直接按8倍降采样
+    RawOptions opt = { 8, false };
+    RawPixelFormat f;
+    s = rawOutputSize(camWidth, camHeight, format, opt, &w, &h, &f);
+    prevFormat = format;
+    if (s > prevPixSize) {
+      prevPixSize = s;
+      prevPix = allocateMemory(prevPix, prevPixSize);
+    }
+    rawConvert((const uint8_t*)camBuf, camWidth, camHeight, format, opt, (uint8_t*)prevPix);
+  }
+  else {
+    return false;
+  }
+
+  if (!fmt2jpg((uint8_t*)prevPix, s, w, h, prevFormat, 30, &prevJpg, &prevJpgSize) || prevJpgSize == 0) {
+    free(prevJpg);
+    prevJpg = NULL;
+    return false;
+  }
+  return true;
+}
+
+// 返回当前帧的缩略图JPEG（调用方持有frameSync）。无法生成时返回false，
+// 失败的结果同样记录下来，同一帧不会为每个客户端重复尝试
+bool currentPreview(const uint8_t** jpg, size_t* jpgSize) {
+  if (prevSeq != camSeq) {
+    prevOk = buildPreview();
+    prevSeq = camSeq;
+  }
+  if (!prevOk) return false;
+
+  *jpg = prevJpg;
+  *jpgSize = prevJpgSize;
+  return true;
+}
+
+// ==== 向一个客户端发送当前帧的缩略图（调用方持有frameSync） ========
+void sendPreviewFrame(StreamClient* sc) {
+  // 缩略图墙不需要重复的帧
+  if (sc->lastSeq == camSeq) return;
+
+  const uint8_t* jpg;
+  size_t jpgSize;
+  bool ok = currentPreview(&jpg, &jpgSize);
+  sc->lastSeq = camSeq;
+  if (!ok) return;
+
+  writeMjpegPart(sc->client, jpg, jpgSize);
+}
+
+// 降采样/灰度变换后的帧按变体缓存，缓冲区中是帧头和紧随的像素
+bool sameRawOptions(const RawOptions& a, const RawOptions& b) {
+  return a.scale == b.scale && a.gray == b.gray;
+}
+FrameVariants<RawOptions> rawVariants;
+
+// ==== 向一个客户端发送当前帧的原始像素（调用方持有frameSync） ======
+void sendRawFrame(StreamClient* sc) {
+  // 只发送最新帧：客户端已经收到过当前帧时跳过
+  if (sc->lastSeq == camSeq) return;
+
+  pixformat_t format = camFormat;
+  if (!rawSupported(format) || camSize == 0) return;
+
+  if (rawIsIdentity(format, sc->raw)) {
+    // 零拷贝：直接从共享的当前帧发送
+    int w, h;
+    RawPixelFormat f;
+    size_t s = rawOutputSize(camWidth, camHeight, format, sc->raw, &w, &h, &f);
+    if (s > camSize) return;
+
+    RawFrameHeader hdr;
+    rawFillHeader(&hdr, w, h, f, camStamp, camSeq, s);
+    sc->client.write((const uint8_t*)&hdr, sizeof(hdr));
+    sc->client.write((const uint8_t*)camBuf, s);
+  }
+  else {
+    int w, h;
+    RawPixelFormat f;
+    size_t s = rawOutputSize(camWidth, camHeight, format, sc->raw, &w, &h, &f);
+    FrameVariants<RawOptions>::Slot* v = rawVariants.get(sc->raw, sizeof(RawFrameHeader) + s, sameRawOptions,
+      [&](uint8_t* buf, size_t cap) {
+        size_t n = rawConvert((const uint8_t*)camBuf, camWidth, camHeight, format, sc->raw,
+                              buf + sizeof(RawFrameHeader));
+        rawFillHeader((RawFrameHeader*)buf, w, h, f, camStamp, camSeq, n);
+        return sizeof(RawFrameHeader) + n;
+      });
+    sc->client.write((const uint8_t*)v->buf, v->len);
+  }
+  sc->lastSeq = camSeq;
 }
 
 // ==== 实际向所有连接的客户端流式传输内容 ========================
 void streamCB(void* pvParameters) {
-  char buf[16];
   TickType_t xLastWakeTime;
   TickType_t xFrequency;
 
@@ -264,14 +753,14 @@ void streamCB(void* pvParameters) {
 
       // 由于我们向每个人发送相同的帧，
       // 从队列前面弹出一个客户端
-      WiFiClient* client;
-      xQueueReceive(streamingClients, (void*)&client, 0);
+      StreamClient* sc;
+      xQueueReceive(streamingClients, (void*)&sc, 0);
 
       // 检查此客户端是否仍然连接。
-      if (!client->connected()) {
+      if (!sc->client.connected()) {
         // 如果他/她已断开连接，请删除此客户端引用
         // 不要再把它放回队列了。再见！
-        delete client;
+        delete sc;
       }
       else {
         // 好的。这是一个积极连接的客户端。
@@ -279,47 +768,21 @@ void streamCB(void* pvParameters) {
         // 正在提供这个帧
         xSemaphoreTake(frameSync, portMAX_DELAY);
 
-        size_t jpgSize = 0;
-        uint8_t* jpgBuf = NULL;
-        
-        // 检查是否需要进行格式转换
-        pixformat_t format = cam.getPixelFormat();
-        if (format != PIXFORMAT_JPEG && camSize > 0) {
-          bool convert_ok = fmt2jpg((uint8_t*)camBuf, camSize, cam.getWidth(), cam.getHeight(), 
-                               format, 30, &jpgBuf, &jpgSize);
-          
-          if (convert_ok && jpgSize > 0) {
-            // 发送转换后的JPEG数据
-            client->write(CTNTTYPE, cntLen);
-            sprintf(buf, "%u\r\n\r\n", jpgSize);
-            client->write(buf, strlen(buf));
-            client->write((char*)jpgBuf, jpgSize);
-            
-            ESP_LOGI(TAG, "格式转换为JPEG成功: %u -> %u bytes", camSize, jpgSize);
-            
-            // 释放转换后的JPEG缓冲区
-            free(jpgBuf);
-          } else {
-            ESP_LOGE(TAG, "格式转换失败，使用原始数据");
-            // 转换失败，发送原始数据
-            client->write(CTNTTYPE, cntLen);
-            sprintf(buf, "%u\r\n\r\n", camSize);
-            client->write(buf, strlen(buf));
-            client->write((char*)camBuf, (size_t)camSize);
-          }
-        } else {
-          // 已经是JPEG格式或数据无效，直接发送
-          client->write(CTNTTYPE, cntLen);
-          sprintf(buf, "%u\r\n\r\n", camSize);
-          client->write(buf, strlen(buf));
-          client->write((char*)camBuf, (size_t)camSize);
+        switch (sc->kind) {
+          case STREAM_RAW:
+            sendRawFrame(sc);
+            break;
+          case STREAM_PREVIEW:
+            sendPreviewFrame(sc);
+            break;
+          default:
+            sendMjpegFrame(sc);
+            break;
         }
-        
-        client->write(BOUNDARY, bdrLen);
 
         // 由于此客户端仍然连接，请将其推到末尾
         // 队列以进行进一步处理
-        xQueueSend(streamingClients, (void*)&client, 0);
+        xQueueSend(streamingClients, (void*)&sc, 0);
 
         // 帧已提供。释放信号量并让其他任务运行。
         // 如果帧切换准备好了，现在将在帧之间发生
@@ -337,11 +800,104 @@ void streamCB(void* pvParameters) {
   }
 }
 
+#ifdef PUSH_HOST
+// ==== 推流模式：每帧只向中继服务器上传一次 ===========================
+// 中继（见 tools/relay）负责分发给任意数量的观看者，设备的上行带宽和
+// socket数量不再随观看者增加。
+const uint32_t PUSH_BACKOFF_MIN = 1000;   // 重连退避，毫秒
+const uint32_t PUSH_BACKOFF_MAX = 30000;
+
+void pushCB(void* pvParameters) {
+  WiFiClient client;
+  uint32_t backoff = PUSH_BACKOFF_MIN;
+  uint32_t lastSeq = 0;
+  char* buf = NULL;
+  size_t bufSize = 0;
+  PushFrameHeader hdr;
+
+  for (;;) {
+    if (!client.connected()) {
+      pushActive = false;
+      if (!client.connect(PUSH_HOST, PUSH_PORT)) {
+        ESP_LOGW(TAG, "无法连接到中继 %s:%d，%lu毫秒后重试", PUSH_HOST, PUSH_PORT, backoff);
+        vTaskDelay(pdMS_TO_TICKS(backoff));
+        backoff = backoff * 2 > PUSH_BACKOFF_MAX ? PUSH_BACKOFF_MAX : backoff * 2;
+        continue;
+      }
+      ESP_LOGI(TAG, "已连接到中继 %s:%d", PUSH_HOST, PUSH_PORT);
+      client.setNoDelay(true);
+      backoff = PUSH_BACKOFF_MIN;
+      pushActive = true;
+      if (eTaskGetState(tCam) == eSuspended) vTaskResume(tCam);
+    }
+
+    // 等待新帧
+    if (camSeq == lastSeq) {
+      vTaskDelay(pdMS_TO_TICKS(1000 / FPS / 2));
+      continue;
+    }
+
+    // 把最新帧复制出来后立即释放frameSync，慢速的上行不会阻塞摄像头。
+    // 发送期间到达的帧被丢弃，下一次总是发送最新的一帧。
+    xSemaphoreTake(frameSync, portMAX_DELAY);
+    const uint8_t* jpg;
+    size_t jpgSize = 0;
+    bool ok = currentJpeg(&jpg, &jpgSize) && jpgSize > 0;
+    if (ok) {
+      if (jpgSize > bufSize) {
+        bufSize = jpgSize * 4 / 3;
+        buf = allocateMemory(buf, bufSize);
+      }
+      memcpy(buf, jpg, jpgSize);
+      hdr.magic = PUSH_FRAME_MAGIC;
+      hdr.seq = camSeq;
+      hdr.timestamp = camStamp;
+      hdr.length = jpgSize;
+    }
+    lastSeq = camSeq;
+    xSemaphoreGive(frameSync);
+    if (!ok) continue;
+
+    if (client.write((const uint8_t*)&hdr, sizeof(hdr)) != sizeof(hdr) ||
+        client.write((const uint8_t*)buf, jpgSize) != jpgSize) {
+      ESP_LOGW(TAG, "推流发送失败，重新连接");
+      client.stop();
+    }
+  }
+}
+#endif
+
 const char JHEADER[] = "HTTP/1.1 200 OK\r\n" \
                      "Content-disposition: inline; filename=capture.jpg\r\n" \
                      "Content-type: image/jpeg\r\n\r\n";
 const int jhdLen = strlen(JHEADER);
 
+// 发送单帧JPEG响应，带有 crop 参数时先在JPEG域中裁剪
+void sendJPG(WiFiClient& client, const uint8_t* jpg, size_t jpgSize) {
+  if (server.hasArg("crop")) {
+    JpegRect roi;
+    if (!jpegParseRect(server.arg("crop").c_str(), &roi)) {
+      server.send(400, "text/plain", "crop must be x,y,w,h\n");
+      return;
+    }
+    // 单次请求的缓冲区，分配失败时发送完整帧而不是像allocateMemory那样重启
+    size_t cap = jpgSize + 1024;
+    uint8_t* cropBuf = (uint8_t*)(psramFound() ? ps_malloc(cap) : malloc(cap));
+    size_t cropSize = cropBuf ? jpegCrop(jpg, jpgSize, roi, cropBuf, cap, NULL) : 0;
+    if (cropSize > 0) {
+      client.write(JHEADER, jhdLen);
+      client.write(cropBuf, cropSize);
+      free(cropBuf);
+      return;
+    }
+    free(cropBuf);
+    ESP_LOGW(TAG, "JPEG裁剪失败，发送完整帧");
+  }
+
+  client.write(JHEADER, jhdLen);
+  client.write(jpg, jpgSize);
+}
+
 // ==== 提供一个JPEG帧 =============================================
 void handleJPG(void) {
   WiFiClient client = server.client();
@@ -360,8 +916,7 @@ void handleJPG(void) {
     
     if (convert_ok && jpgSize > 0) {
       // 发送转换后的JPEG数据
-      client.write(JHEADER, jhdLen);
-      client.write((char*)jpgBuf, jpgSize);
+      sendJPG(client, jpgBuf, jpgSize);
       
       ESP_LOGI(TAG, "格式转换为JPEG成功: %u -> %u bytes", cam.getSize(), jpgSize);
       
@@ -370,12 +925,138 @@ void handleJPG(void) {
       return;
     } else {
       ESP_LOGE(TAG, "格式转换失败，使用原始数据");
+      client.write(JHEADER, jhdLen);
+      client.write((char*)cam.getfb(), cam.getSize());
+      return;
     }
   }
   
-  // 默认或转换失败时，直接发送原始数据
-  client.write(JHEADER, jhdLen);
-  client.write((char*)cam.getfb(), cam.getSize());
+  // 已经是JPEG格式，直接发送
+  sendJPG(client, cam.getfb(), cam.getSize());
+}
+
+// ==== 运行时重新配置摄像头 =========================================
+// /control?framesize=VGA&format=jpeg&quality=12&xclk=20
+// 未给出的参数保持不变。已连接的客户端不断开，下一帧起使用新配置
+struct FrameSizeName {
+  const char* name;
+  framesize_t size;
+};
+const FrameSizeName FRAMESIZES[] = {
+  { "96X96", FRAMESIZE_96X96 },  { "QQVGA", FRAMESIZE_QQVGA }, { "QCIF", FRAMESIZE_QCIF },
+  { "HQVGA", FRAMESIZE_HQVGA },  { "240X240", FRAMESIZE_240X240 }, { "QVGA", FRAMESIZE_QVGA },
+  { "CIF", FRAMESIZE_CIF },      { "HVGA", FRAMESIZE_HVGA },   { "VGA", FRAMESIZE_VGA },
+  { "SVGA", FRAMESIZE_SVGA },    { "XGA", FRAMESIZE_XGA },     { "HD", FRAMESIZE_HD },
+  { "SXGA", FRAMESIZE_SXGA },    { "UXGA", FRAMESIZE_UXGA },
+};
+const int FRAMESIZE_COUNT = sizeof(FRAMESIZES) / sizeof(FRAMESIZES[0]);
+
+struct PixFormatName {
+  const char* name;
+  pixformat_t format;
+};
+const PixFormatName PIXFORMATS[] = {
+  { "jpeg", PIXFORMAT_JPEG }, { "rgb565", PIXFORMAT_RGB565 },
+  { "yuv422", PIXFORMAT_YUV422 }, { "gray", PIXFORMAT_GRAYSCALE },
+};
+const int PIXFORMAT_COUNT = sizeof(PIXFORMATS) / sizeof(PIXFORMATS[0]);
+
+const char* frameSizeName(framesize_t size) {
+  for (int i = 0; i < FRAMESIZE_COUNT; i++) {
+    if (FRAMESIZES[i].size == size) return FRAMESIZES[i].name;
+  }
+  return "?";
+}
+
+const char* pixFormatName(pixformat_t format) {
+  for (int i = 0; i < PIXFORMAT_COUNT; i++) {
+    if (PIXFORMATS[i].format == format) return PIXFORMATS[i].name;
+  }
+  return "?";
+}
+
+void handleControl(void) {
+  CamControl c;
+  c.size = cam.getFrameSize();
+  c.format = cam.getPixelFormat();
+  c.quality = cam.getQuality();
+  c.xclk = cam.getXclk();
+  c.result = ESP_OK;
+  c.reinit = false;
+  c.applyUs = 0;
+  c.stackFree = 0;
+
+  if (server.hasArg("framesize")) {
+    String v = server.arg("framesize");
+    v.toUpperCase();
+    int i = 0;
+    while (i < FRAMESIZE_COUNT && v != FRAMESIZES[i].name) i++;
+    if (i == FRAMESIZE_COUNT) {
+      server.send(400, "text/plain", "framesize must be one of 96X96 QQVGA QCIF HQVGA 240X240 QVGA CIF HVGA VGA SVGA XGA HD SXGA UXGA\n");
+      return;
+    }
+    c.size = FRAMESIZES[i].size;
+  }
+  if (server.hasArg("format")) {
+    String v = server.arg("format");
+    v.toLowerCase();
+    int i = 0;
+    while (i < PIXFORMAT_COUNT && v != PIXFORMATS[i].name) i++;
+    if (i == PIXFORMAT_COUNT) {
+      server.send(400, "text/plain", "format must be jpeg, rgb565, yuv422 or gray\n");
+      return;
+    }
+    c.format = PIXFORMATS[i].format;
+  }
+  if (server.hasArg("quality")) {
+    c.quality = server.arg("quality").toInt();
+    if (c.quality < 0 || c.quality > 63) {
+      server.send(400, "text/plain", "quality must be 0-63\n");
+      return;
+    }
+  }
+  if (server.hasArg("xclk")) {
+    // MHz
+    int mhz = server.arg("xclk").toInt();
+    if (mhz < 8 || mhz > 20) {
+      server.send(400, "text/plain", "xclk must be 8-20 (MHz)\n");
+      return;
+    }
+    c.xclk = mhz * 1000000;
+  }
+
+  uint32_t t0 = micros();
+  if (server.args() > 0) {
+    // 交给抓帧任务在两帧之间应用。没有客户端时它会挂起自己，
+    // 所以等待期间确保它在运行
+    camControl = &c;
+    while (xSemaphoreTake(controlDone, pdMS_TO_TICKS(1000 / FPS)) != pdTRUE) {
+      if (eTaskGetState(tCam) == eSuspended) vTaskResume(tCam);
+    }
+  }
+  uint32_t totalUs = micros() - t0;
+
+  if (c.result != ESP_OK) {
+    ESP_LOGE(TAG, "摄像头重新配置失败: 0x%x", c.result);
+  }
+  else if (server.args() > 0) {
+    ESP_LOGI(TAG, "摄像头重新配置: %s %s q%d %dMHz，%s，暂停%lu us，总计%lu us，抓帧任务堆栈剩余%lu字节",
+             frameSizeName(c.size), pixFormatName(c.format), c.quality, c.xclk / 1000000,
+             c.reinit ? "重新初始化驱动" : "只设置传感器", (unsigned long)c.applyUs, (unsigned long)totalUs,
+             (unsigned long)c.stackFree);
+  }
+
+  // 返回摄像头当前（失败时为恢复后）的配置和本次的耗时
+  char buf[256];
+  snprintf(buf, sizeof(buf),
+           "{\"ok\":%s,\"framesize\":\"%s\",\"format\":\"%s\",\"quality\":%d,\"xclk\":%d,"
+           "\"reinit\":%s,\"apply_us\":%lu,\"total_us\":%lu,\"stack_free\":%lu}\n",
+           c.result == ESP_OK ? "true" : "false",
+           frameSizeName(cam.getFrameSize()), pixFormatName(cam.getPixelFormat()),
+           cam.getQuality(), cam.getXclk() / 1000000,
+           c.reinit ? "true" : "false", (unsigned long)c.applyUs, (unsigned long)totalUs,
+           (unsigned long)c.stackFree);
+  server.send(c.result == ESP_OK ? 200 : 500, "application/json", buf);
 }
 
 // ==== 处理无效的URL请求 ============================================
@@ -433,6 +1114,13 @@ extern "C" void app_main() {
     ESP.restart();
   }
   Serial.println("相机初始化成功");
+
+#if HUFF_OPTIMIZE
+  // 在任何任务使用之前分配Huffman优化器
+  void* optMem = psramFound() ? ps_malloc(sizeof(JpegHuffOptimizer)) : NULL;
+  if (optMem == NULL) optMem = allocateMemory(NULL, sizeof(JpegHuffOptimizer));
+  huffOpt = new (optMem) JpegHuffOptimizer(HUFF_REBUILD_FRAMES);
+#endif
   
   // 配置并连接到WiFi
   IPAddress ip;
@@ -450,6 +1138,9 @@ extern "C" void app_main() {
   Serial.print("流链接: http://");
   Serial.print(ip);
   Serial.println("/mjpeg/1");
+#ifdef PUSH_HOST
+  Serial.printf("推流到中继: %s:%d\n", PUSH_HOST, PUSH_PORT);
+#endif
   
   // 启动主流RTOS任务
   xTaskCreatePinnedToCore(
@@ -0,0 +1,134 @@
+// 主机工具共用的libjpeg辅助函数：生成测试图像、编码和解码，以及读文件和计时。
+// 只用于 tools/ 下的基准测试和参考对比，不参与固件构建。
+#ifndef TOOLS_LIBJPEG_H_
+#define TOOLS_LIBJPEG_H_
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+
+#include <chrono>
+#include <vector>
+
+#include <jpeglib.h>
+
+struct JpegParams {
+    int width, height;
+    int ncomp;             // 1 = 灰度，3 = YCbCr
+    int hs, vs;            // 亮度采样因子：2x1 = 4:2:2，2x2 = 4:2:0，1x1 = 4:4:4
+    int quality;
+    int restart;           // DRI间隔（MCU数），0表示没有
+};
+
+// 带平滑渐变、棋盘格和少量噪声的测试图像，熵数据量接近真实场景
+static std::vector<uint8_t> makeScene(int w, int h, int ncomp, int seed)
+{
+    std::vector<uint8_t> px((size_t)w * h * ncomp);
+    uint32_t s = seed;
+    for (int y = 0; y < h; y++) {
+        for (int x = 0; x < w; x++) {
+            double v = 128 + 60 * sin(x * 0.02 + seed) * cos(y * 0.03) + ((x / 40 + y / 40) % 2 ? 30 : -30);
+            for (int c = 0; c < ncomp; c++) {
+                s = s * 1103515245 + 12345;
+                int q = (int)(v + c * 20 * sin(y * 0.01) + ((s >> 16) & 7));
+                px[((size_t)y * w + x) * ncomp + c] = q < 0 ? 0 : q > 255 ? 255 : q;
+            }
+        }
+    }
+    return px;
+}
+
+static std::vector<uint8_t> encodeJpeg(const std::vector<uint8_t>& px, const JpegParams& p)
+{
+    jpeg_compress_struct c;
+    jpeg_error_mgr e;
+    c.err = jpeg_std_error(&e);
+    jpeg_create_compress(&c);
+
+    unsigned char* out = NULL;
+    unsigned long size = 0;
+    jpeg_mem_dest(&c, &out, &size);
+
+    c.image_width = p.width;
+    c.image_height = p.height;
+    c.input_components = p.ncomp;
+    c.in_color_space = p.ncomp == 3 ? JCS_RGB : JCS_GRAYSCALE;
+    jpeg_set_defaults(&c);
+    jpeg_set_quality(&c, p.quality, TRUE);
+    c.restart_interval = p.restart;
+    if (p.ncomp == 3) {
+        c.comp_info[0].h_samp_factor = p.hs;
+        c.comp_info[0].v_samp_factor = p.vs;
+    }
+
+    jpeg_start_compress(&c, TRUE);
+    while (c.next_scanline < c.image_height) {
+        JSAMPROW row = (JSAMPROW)&px[(size_t)c.next_scanline * p.width * p.ncomp];
+        jpeg_write_scanlines(&c, &row, 1);
+    }
+    jpeg_finish_compress(&c);
+
+    std::vector<uint8_t> v(out, out + size);
+    free(out);
+    jpeg_destroy_compress(&c);
+    return v;
+}
+
+// 解码为RGB或灰度。scaleDenom为8时使用libjpeg的1/8缩放（只用DC系数）。
+// 关闭平滑上采样并使用整数IDCT，输出与MCU对齐的子区域完全可比
+static bool decodeJpeg(const uint8_t* data, size_t len, std::vector<uint8_t>& px,
+                       int* w, int* h, int* ncomp, int scaleDenom = 1)
+{
+    jpeg_decompress_struct c;
+    jpeg_error_mgr e;
+    c.err = jpeg_std_error(&e);
+    jpeg_create_decompress(&c);
+
+    jpeg_mem_src(&c, (unsigned char*)data, len);
+    if (jpeg_read_header(&c, TRUE) != JPEG_HEADER_OK) {
+        jpeg_destroy_decompress(&c);
+        return false;
+    }
+    c.scale_num = 1;
+    c.scale_denom = scaleDenom;
+    c.do_fancy_upsampling = FALSE;
+    c.dct_method = JDCT_ISLOW;
+
+    jpeg_start_decompress(&c);
+    *w = c.output_width;
+    *h = c.output_height;
+    *ncomp = c.output_components;
+    px.resize((size_t)*w * *h * *ncomp);
+    while (c.output_scanline < c.output_height) {
+        JSAMPROW row = &px[(size_t)c.output_scanline * *w * *ncomp];
+        jpeg_read_scanlines(&c, &row, 1);
+    }
+
+    bool ok = e.num_warnings == 0;
+    jpeg_finish_decompress(&c);
+    jpeg_destroy_decompress(&c);
+    return ok;
+}
+
+static bool readFile(const char* path, std::vector<uint8_t>& data)
+{
+    FILE* f = fopen(path, "rb");
+    if (f == NULL) return false;
+    fseek(f, 0, SEEK_END);
+    long size = ftell(f);
+    fseek(f, 0, SEEK_SET);
+    data.resize(size > 0 ? size : 0);
+    bool ok = size > 0 && fread(data.data(), 1, size, f) == (size_t)size;
+    fclose(f);
+    return ok;
+}
+
+typedef std::chrono::steady_clock Clock;
+
+static double elapsedUs(Clock::time_point t0)
+{
+    return std::chrono::duration<double, std::micro>(Clock::now() - t0).count();
+}
+
+#endif //TOOLS_LIBJPEG_H_
@@ -0,0 +1,146 @@
+// JPEG域裁剪的主机检查和基准测试。
+//
+// 用法: cropbench [-c x,y,w,h] [-r 次数] [frame.jpg ...]
+//   先用libjpeg生成多种采样方式、DRI和奇数尺寸的测试图像，检查 jpegCrop 的结果
+//   解码后与完整帧解码后的对应区域逐像素一致；然后比较 jpegCrop 与
+//   libjpeg 解码+裁剪+编码 的耗时。给出帧文件时用它们做基准测试，否则用合成的800x600帧。
+//   有不一致时返回非0。
+
+#include "JpegCrop.h"
+#include "LibJpeg.h"
+
+#include <string.h>
+
+// 裁剪后解码的每个像素都必须与完整帧解码后的相应像素相同
+static bool checkCrop(const JpegParams& p, const JpegRect& roi)
+{
+    std::vector<uint8_t> src = encodeJpeg(makeScene(p.width, p.height, p.ncomp, p.width + p.height), p);
+    std::vector<uint8_t> full, part;
+    int fw, fh, fc, cw, ch, cc;
+    decodeJpeg(src.data(), src.size(), full, &fw, &fh, &fc);
+
+    std::vector<uint8_t> dst(src.size() + 4096);
+    JpegRect actual;
+    size_t n = jpegCrop(src.data(), src.size(), roi, dst.data(), dst.size(), &actual);
+
+    const char* err = NULL;
+    int diff = 0;
+    if (n == 0)
+        err = "jpegCrop失败";
+    else if (!decodeJpeg(dst.data(), n, part, &cw, &ch, &cc))
+        err = "输出无法无警告地解码";
+    else if (cw != actual.w || ch != actual.h || cc != fc)
+        err = "尺寸不符";
+    else {
+        for (int y = 0; y < ch; y++) {
+            const uint8_t* a = &part[(size_t)y * cw * cc];
+            const uint8_t* b = &full[((size_t)(y + actual.y) * fw + actual.x) * fc];
+            for (int x = 0; x < cw * cc; x++) diff += a[x] != b[x];
+        }
+        if (diff) err = "像素不一致";
+    }
+
+    printf("%s %dx%d %s rst%d 区域(%d,%d,%d,%d) -> (%d,%d,%d,%d) %zu -> %zu bytes",
+           err ? "FAIL" : "ok  ", p.width, p.height,
+           p.ncomp == 1 ? "gray" : p.hs == 2 && p.vs == 2 ? "4:2:0" : p.hs == 2 ? "4:2:2" : "4:4:4",
+           p.restart, roi.x, roi.y, roi.w, roi.h, actual.x, actual.y, actual.w, actual.h, src.size(), n);
+    if (err) printf("  %s（%d个像素不同）", err, diff);
+    printf("\n");
+    return err == NULL;
+}
+
+// 参考做法：完整解码，复制区域，按相同的采样方式重新编码
+static size_t referenceCrop(const std::vector<uint8_t>& src, const JpegRect& roi, int quality)
+{
+    std::vector<uint8_t> full;
+    int w, h, nc;
+    decodeJpeg(src.data(), src.size(), full, &w, &h, &nc);
+
+    int x0 = roi.x < w ? roi.x : w - 1;
+    int y0 = roi.y < h ? roi.y : h - 1;
+    int cw = x0 + roi.w <= w ? roi.w : w - x0;
+    int ch = y0 + roi.h <= h ? roi.h : h - y0;
+    std::vector<uint8_t> part((size_t)cw * ch * nc);
+    for (int y = 0; y < ch; y++)
+        memcpy(&part[(size_t)y * cw * nc], &full[((size_t)(y + y0) * w + x0) * nc], (size_t)cw * nc);
+
+    JpegParams p = { cw, ch, nc, 2, 1, quality, 0 };
+    return encodeJpeg(part, p).size();
+}
+
+static void bench(const char* name, const std::vector<uint8_t>& src, const JpegRect& roi, int rounds)
+{
+    std::vector<uint8_t> dst(src.size() + 4096);
+    size_t n = 0;
+    Clock::time_point t0 = Clock::now();
+    for (int i = 0; i < rounds; i++) n = jpegCrop(src.data(), src.size(), roi, dst.data(), dst.size(), NULL);
+    double cropUs = elapsedUs(t0) / rounds;
+
+    size_t ref = 0;
+    t0 = Clock::now();
+    for (int i = 0; i < rounds; i++) ref = referenceCrop(src, roi, 80);
+    double refUs = elapsedUs(t0) / rounds;
+
+    printf("%s: %zu bytes，区域(%d,%d,%d,%d)\n", name, src.size(), roi.x, roi.y, roi.w, roi.h);
+    printf("  jpegCrop            %8.1f us  %zu bytes%s\n", cropUs, n, n ? "" : "（不支持，发送完整帧）");
+    printf("  解码+裁剪+编码(q80) %8.1f us  %zu bytes\n", refUs, ref);
+}
+
+int main(int argc, char** argv)
+{
+    JpegRect roi = { 200, 150, 320, 240 };
+    int rounds = 100;
+    std::vector<const char*> files;
+
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "-c") == 0 && i + 1 < argc) {
+            if (!jpegParseRect(argv[++i], &roi)) {
+                fprintf(stderr, "区域格式应为 x,y,w,h\n");
+                return 1;
+            }
+        }
+        else if (strcmp(argv[i], "-r") == 0 && i + 1 < argc) {
+            rounds = atoi(argv[++i]);
+        }
+        else {
+            files.push_back(argv[i]);
+        }
+    }
+    if (rounds <= 0) rounds = 1;
+
+    // 采样方式、DRI、灰度、非MCU整数倍的尺寸以及靠边缘的区域
+    struct Case {
+        JpegParams p;
+        JpegRect roi;
+    } cases[] = {
+        { { 160, 120, 3, 2, 1, 80, 0 }, { 10, 10, 50, 40 } },
+        { { 160, 120, 3, 2, 2, 80, 0 }, { 100, 90, 60, 30 } },
+        { { 157, 117, 3, 2, 1, 80, 0 }, { 100, 90, 200, 200 } },
+        { { 640, 480, 3, 2, 1, 80, 3 }, { 33, 77, 123, 99 } },
+        { { 640, 480, 3, 2, 2, 70, 4 }, { 250, 100, 200, 150 } },
+        { { 640, 480, 1, 1, 1, 80, 5 }, { 0, 0, 640, 480 } },
+        { { 321, 241, 1, 1, 1, 80, 0 }, { 300, 200, 50, 50 } },
+        { { 800, 600, 3, 1, 1, 80, 7 }, { 400, 300, 16, 16 } },
+    };
+    int fails = 0;
+    for (const Case& c : cases) {
+        if (!checkCrop(c.p, c.roi)) fails++;
+    }
+    printf("\n");
+
+    if (files.empty()) {
+        JpegParams p = { 800, 600, 3, 2, 1, 80, 0 };
+        bench("合成帧 800x600 4:2:2 q80", encodeJpeg(makeScene(800, 600, 3, 1), p), roi, rounds);
+    }
+    for (const char* f : files) {
+        std::vector<uint8_t> src;
+        if (!readFile(f, src)) {
+            fprintf(stderr, "无法读取 %s\n", f);
+            return 1;
+        }
+        bench(f, src, roi, rounds);
+    }
+
+    if (fails) printf("\n%d 项检查失败\n", fails);
+    return fails ? 1 : 0;
+}
@@ -0,0 +1,144 @@
+// Huffman表优化的主机检查和基准测试：统计节省的字节数和花费的CPU时间。
+//
+// 用法: huffbench [-n 重建间隔] [-r 轮数] [frame1.jpg frame2.jpg ...]
+//   按顺序把各帧送入 JpegHuffOptimizer，重复 -r 轮（默认10），模拟连续的视频流。
+//   帧可以用 curl http://<设备>/jpg -o frameN.jpg 从设备上采集；不给出帧文件时
+//   用合成的帧序列（多种采样方式、DRI和灰度，中途切换以触发重建表）。
+//   每个优化后的帧都用libjpeg解码，与原帧解码结果逐像素比较，有不一致时返回非0。
+//
+// 同时测量只做熵解码的时间，作为优化器开销中不可避免的那一部分的参考。
+
+#include "JpegHuffOpt.h"
+#include "JpegScan.h"
+#include "LibJpeg.h"
+
+#include <string.h>
+
+#include <memory>
+#include <string>
+
+// 只解码不做任何事，用来测量熵解码本身的开销
+class NullVisitor : public JpegBlockVisitor
+{
+public:
+    bool block(int comp, int bx, int by, const int16_t* zz) override
+    {
+        return true;
+    }
+};
+
+struct Frame {
+    std::string name;
+    std::vector<uint8_t> data;
+    std::vector<uint8_t> pixels;   // 原帧的解码结果，用于无损检查
+    bool decoded;                  // libjpeg能否无警告地解码原帧
+};
+
+// 优化后的帧解码后必须与原帧完全相同
+static bool checkLossless(const Frame& f, const uint8_t* out, size_t n)
+{
+    std::vector<uint8_t> px;
+    int w, h, nc;
+    return decodeJpeg(out, n, px, &w, &h, &nc) && px == f.pixels;
+}
+
+int main(int argc, char** argv)
+{
+    int rebuildFrames = 30;
+    int rounds = 10;
+    std::vector<Frame> frames;
+
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "-n") == 0 && i + 1 < argc) {
+            rebuildFrames = atoi(argv[++i]);
+        }
+        else if (strcmp(argv[i], "-r") == 0 && i + 1 < argc) {
+            rounds = atoi(argv[++i]);
+        }
+        else {
+            frames.emplace_back();
+            frames.back().name = argv[i];
+            if (!readFile(argv[i], frames.back().data)) {
+                fprintf(stderr, "无法读取 %s\n", argv[i]);
+                return 1;
+            }
+        }
+    }
+    if (rebuildFrames <= 0 || rounds <= 0) {
+        fprintf(stderr, "用法: %s [-n 重建间隔] [-r 轮数] [frame1.jpg frame2.jpg ...]\n", argv[0]);
+        return 1;
+    }
+
+    if (frames.empty()) {
+        // 每种格式连续若干帧，画面逐帧略有变化
+        JpegParams kinds[] = {
+            { 800, 600, 3, 2, 1, 80, 0 },
+            { 640, 480, 3, 2, 2, 70, 4 },
+            { 320, 240, 1, 1, 1, 75, 0 },
+            { 401, 299, 3, 1, 1, 90, 7 },
+        };
+        for (const JpegParams& p : kinds) {
+            for (int i = 0; i < 5; i++) {
+                char name[64];
+                snprintf(name, sizeof(name), "合成帧 %dx%d q%d #%d", p.width, p.height, p.quality, i);
+                frames.emplace_back();
+                frames.back().name = name;
+                frames.back().data = encodeJpeg(makeScene(p.width, p.height, p.ncomp, i), p);
+            }
+        }
+    }
+
+    for (Frame& f : frames) {
+        int w, h, nc;
+        f.decoded = decodeJpeg(f.data.data(), f.data.size(), f.pixels, &w, &h, &nc);
+        if (!f.decoded) printf("%s: libjpeg解码原帧时有警告，不做无损检查\n", f.name.c_str());
+    }
+
+    // 两个对象都带有JpegScan，放在堆上
+    auto opt = std::make_unique<JpegHuffOptimizer>(rebuildFrames);
+    std::unique_ptr<JpegScan> scan(JpegScan::create());
+
+    std::vector<uint8_t> dst;
+    uint64_t total = 0, passed = 0;
+    double optUs = 0, decodeUs = 0;
+    int count = 0, unsupported = 0, fails = 0;
+
+    for (int r = 0; r < rounds; r++) {
+        for (const Frame& f : frames) {
+            dst.resize(f.data.size() + 1024);
+
+            Clock::time_point t0 = Clock::now();
+            size_t n = opt->process(f.data.data(), f.data.size(), dst.data(), dst.size());
+            optUs += elapsedUs(t0);
+
+            t0 = Clock::now();
+            NullVisitor v;
+            if (!scan->parse(f.data.data(), f.data.size()) || !scan->decode(v)) unsupported++;
+            decodeUs += elapsedUs(t0);
+
+            if (n > 0 && f.decoded && !checkLossless(f, dst.data(), n)) {
+                printf("FAIL 第%d轮 %s: 优化后的帧与原帧解码结果不同\n", r, f.name.c_str());
+                fails++;
+            }
+
+            // 没有输出的帧按原样发送
+            total += f.data.size();
+            passed += n > 0 ? n : f.data.size();
+            count++;
+        }
+    }
+
+    printf("帧数 %d（%zu 帧 x %d 轮），重建间隔 %d 帧，不支持的帧 %d\n",
+           count, frames.size(), rounds, rebuildFrames, unsupported);
+    printf("输出优化结果的帧 %u（已与原帧的libjpeg解码结果比较），重建表 %u 次\n", opt->frames, opt->rebuilds);
+    printf("字节: %llu -> %llu，节省 %.1f%%（平均每帧 %.0f 字节）\n",
+           (unsigned long long)total, (unsigned long long)passed,
+           total ? 100.0 * (total - passed) / total : 0.0,
+           count ? (double)(total - passed) / count : 0.0);
+    printf("CPU: 优化 %.0f us/帧，其中熵解码约 %.0f us/帧；每节省1KB花费 %.0f us\n",
+           optUs / count, decodeUs / count,
+           total > passed ? optUs / ((total - passed) / 1024.0) : 0.0);
+
+    if (fails) printf("\n%d 帧不是无损的\n", fails);
+    return fails ? 1 : 0;
+}
@@ -0,0 +1,122 @@
+// DC系数缩略图的主机检查和基准测试。
+//
+// 用法: previewbench [-r 次数] [frame.jpg ...]
+//   把 jpegPreview 的输出与 libjpeg 的1/8缩放（scale_denom=8，只用DC系数）逐像素比较：
+//   灰度、4:2:2和4:4:4必须完全一致；4:2:0的色度在libjpeg中按不同的方式合并，
+//   颜色转换的舍入允许相差4以内。然后比较 jpegPreview 与完整解码的耗时。
+//   给出帧文件时用它们做基准测试，否则用合成的800x600帧。有不一致时返回非0。
+
+#include "JpegPreview.h"
+#include "LibJpeg.h"
+
+#include <string.h>
+
+static bool checkPreview(const JpegParams& p)
+{
+    std::vector<uint8_t> src = encodeJpeg(makeScene(p.width, p.height, p.ncomp, p.width), p);
+
+    int w, h, rw = 0, rh = 0, rc = 0;
+    bool gray;
+    std::vector<uint8_t> out((size_t)p.width * p.height * 3), ref;
+    const char* err = NULL;
+    int maxDiff = 0;
+    int tolerance = p.ncomp == 3 && p.hs == 2 && p.vs == 2 ? 4 : 0;
+
+    if (!jpegPreview(src.data(), src.size(), out.data(), out.size(), &w, &h, &gray))
+        err = "jpegPreview失败";
+    else if (!decodeJpeg(src.data(), src.size(), ref, &rw, &rh, &rc, 8))
+        err = "参考解码失败";
+    else if (rw != w || rh != h || rc != (gray ? 1 : 3))
+        err = "尺寸不符";
+    else {
+        // jpegPreview输出BGR，libjpeg输出RGB
+        for (int i = 0; i < w * h; i++) {
+            for (int c = 0; c < rc; c++) {
+                int a = out[(size_t)i * rc + (rc == 3 ? 2 - c : c)];
+                int b = ref[(size_t)i * rc + c];
+                int d = a > b ? a - b : b - a;
+                if (d > maxDiff) maxDiff = d;
+            }
+        }
+        if (maxDiff > tolerance) err = "像素差超出允许范围";
+    }
+
+    printf("%s %dx%d %s rst%d -> %dx%d 最大差 %d（允许 %d）",
+           err ? "FAIL" : "ok  ", p.width, p.height,
+           p.ncomp == 1 ? "gray" : p.hs == 2 && p.vs == 2 ? "4:2:0" : p.hs == 2 ? "4:2:2" : "4:4:4",
+           p.restart, rw, rh, maxDiff, tolerance);
+    if (err) printf("  %s", err);
+    printf("\n");
+    return err == NULL;
+}
+
+static void bench(const char* name, const std::vector<uint8_t>& src, int rounds)
+{
+    int w = 0, h = 0, nc;
+    bool gray;
+    std::vector<uint8_t> out;
+    jpegPreview(src.data(), src.size(), NULL, 0, &w, &h, &gray);
+    if (w == 0) {
+        printf("%s: 不受支持\n", name);
+        return;
+    }
+    out.resize((size_t)w * h * 3);
+
+    Clock::time_point t0 = Clock::now();
+    for (int i = 0; i < rounds; i++) jpegPreview(src.data(), src.size(), out.data(), out.size(), &w, &h, &gray);
+    double prevUs = elapsedUs(t0) / rounds;
+
+    std::vector<uint8_t> full;
+    int fw, fh;
+    t0 = Clock::now();
+    for (int i = 0; i < rounds; i++) decodeJpeg(src.data(), src.size(), full, &fw, &fh, &nc);
+    double fullUs = elapsedUs(t0) / rounds;
+
+    printf("%s: %zu bytes %dx%d -> %dx%d\n", name, src.size(), fw, fh, w, h);
+    printf("  jpegPreview   %8.1f us/帧（%.1f MB/s熵数据）\n", prevUs, src.size() / prevUs);
+    printf("  libjpeg完整解码 %8.1f us/帧\n", fullUs);
+}
+
+int main(int argc, char** argv)
+{
+    int rounds = 200;
+    std::vector<const char*> files;
+
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "-r") == 0 && i + 1 < argc)
+            rounds = atoi(argv[++i]);
+        else
+            files.push_back(argv[i]);
+    }
+    if (rounds <= 0) rounds = 1;
+
+    JpegParams cases[] = {
+        { 160, 120, 3, 2, 1, 85, 0 },
+        { 641, 479, 3, 2, 2, 85, 4 },
+        { 800, 600, 3, 1, 1, 85, 0 },
+        { 320, 240, 1, 1, 1, 85, 0 },
+        { 327, 243, 1, 1, 1, 85, 3 },
+        { 1600, 1200, 3, 2, 1, 85, 0 },
+    };
+    int fails = 0;
+    for (const JpegParams& p : cases) {
+        if (!checkPreview(p)) fails++;
+    }
+    printf("\n");
+
+    if (files.empty()) {
+        JpegParams p = { 800, 600, 3, 2, 1, 85, 0 };
+        bench("合成帧 800x600 4:2:2 q85", encodeJpeg(makeScene(800, 600, 3, 1), p), rounds);
+    }
+    for (const char* f : files) {
+        std::vector<uint8_t> src;
+        if (!readFile(f, src)) {
+            fprintf(stderr, "无法读取 %s\n", f);
+            return 1;
+        }
+        bench(f, src, rounds);
+    }
+
+    if (fails) printf("\n%d 项检查失败\n", fails);
+    return fails ? 1 : 0;
+}
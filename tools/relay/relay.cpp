@@ -0,0 +1,259 @@
+// MJPEG中继：接收设备推流模式上传的帧，并以MJPEG分发给任意数量的HTTP观看者。
+//
+// 用法: relay [ingest_port] [http_port]
+//   设备连接到 ingest_port（默认8081），按 PushProtocol.h 的格式发送帧；
+//   观看者访问 http://<host>:<http_port>/mjpeg/1（默认8080）或 /jpg。
+//
+// 每个观看者一个线程，所有观看者共享同一个不可变的帧缓冲区。
+// 慢速观看者只会跳过中间的帧，不会拖慢设备或其他观看者。
+
+#include "PushProtocol.h"
+
+#include <arpa/inet.h>
+#include <errno.h>
+#include <endian.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <chrono>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+typedef std::shared_ptr<const std::vector<uint8_t>> FramePtr;
+
+// 最新的一帧及其序号，由接收线程发布
+static std::mutex frameLock;
+static std::condition_variable frameReady;
+static FramePtr latestFrame;
+static uint64_t latestSeq = 0;
+
+// 设备连接多久收不到数据就认为已断开
+static const int DEVICE_TIMEOUT_S = 10;
+
+static const char HEADER[] = "HTTP/1.1 200 OK\r\n"
+                             "Access-Control-Allow-Origin: *\r\n"
+                             "Content-Type: multipart/x-mixed-replace; boundary=123456789000000000000987654321\r\n";
+static const char BOUNDARY[] = "\r\n--123456789000000000000987654321\r\n";
+static const char JHEADER[] = "HTTP/1.1 200 OK\r\n"
+                              "Content-disposition: inline; filename=capture.jpg\r\n"
+                              "Content-type: image/jpeg\r\n";
+
+static bool sendAll(int fd, const void* data, size_t len)
+{
+    const char* p = (const char*)data;
+    while (len > 0) {
+        ssize_t n = send(fd, p, len, MSG_NOSIGNAL);
+        if (n <= 0) return false;
+        p += n;
+        len -= n;
+    }
+    return true;
+}
+
+static bool recvAll(int fd, void* data, size_t len)
+{
+    char* p = (char*)data;
+    while (len > 0) {
+        ssize_t n = recv(fd, p, len, 0);
+        if (n <= 0) return false;
+        p += n;
+        len -= n;
+    }
+    return true;
+}
+
+// 观看者只在发送时才能发现断开；设备离线时没有帧可发，需要主动检查
+static bool peerClosed(int fd)
+{
+    char c;
+    ssize_t n = recv(fd, &c, 1, MSG_PEEK | MSG_DONTWAIT);
+    if (n > 0) return false;
+    return n == 0 || (errno != EAGAIN && errno != EWOULDBLOCK);
+}
+
+static int listenOn(int port)
+{
+    int fd = socket(AF_INET, SOCK_STREAM, 0);
+    if (fd < 0) return -1;
+    int one = 1;
+    setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+
+    sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_ANY);
+    addr.sin_port = htons(port);
+    if (bind(fd, (sockaddr*)&addr, sizeof(addr)) < 0 || listen(fd, 16) < 0) {
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+// 发布新帧并唤醒所有观看者
+static void publish(FramePtr frame)
+{
+    {
+        std::lock_guard<std::mutex> lock(frameLock);
+        latestFrame = frame;
+        latestSeq++;
+    }
+    frameReady.notify_all();
+}
+
+// ==== 设备连接：读取帧直到连接断开 ==============================
+static void serveDevice(int fd, std::string peer)
+{
+    printf("设备已连接: %s\n", peer.c_str());
+
+    // 设备每秒发送多帧；长时间收不到数据说明连接已半开（例如设备断电），关闭它
+    timeval tv = { DEVICE_TIMEOUT_S, 0 };
+    setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+    PushFrameHeader hdr;
+    uint32_t lastSeq = 0;
+    uint64_t frames = 0, dropped = 0;
+
+    while (recvAll(fd, &hdr, sizeof(hdr))) {
+        uint32_t magic = le32toh(hdr.magic);
+        uint32_t seq = le32toh(hdr.seq);
+        uint32_t len = le32toh(hdr.length);
+        if (magic != PUSH_FRAME_MAGIC || len == 0 || len > PUSH_MAX_FRAME) {
+            fprintf(stderr, "无效的帧头，断开设备 %s\n", peer.c_str());
+            break;
+        }
+
+        auto frame = std::make_shared<std::vector<uint8_t>>(len);
+        if (!recvAll(fd, frame->data(), len)) break;
+
+        // 序号跳变说明设备因上行拥塞丢弃了帧
+        if (frames > 0 && seq > lastSeq + 1) dropped += seq - lastSeq - 1;
+        lastSeq = seq;
+        frames++;
+        publish(frame);
+    }
+
+    printf("设备已断开: %s（收到 %llu 帧，设备端丢弃 %llu 帧）\n", peer.c_str(),
+           (unsigned long long)frames, (unsigned long long)dropped);
+    close(fd);
+}
+
+static void ingestLoop(int lfd)
+{
+    for (;;) {
+        sockaddr_in addr;
+        socklen_t alen = sizeof(addr);
+        int fd = accept(lfd, (sockaddr*)&addr, &alen);
+        if (fd < 0) continue;
+
+        // 设备只有一个，但重连时旧连接可能还没超时，允许并存
+        std::string peer = std::string(inet_ntoa(addr.sin_addr)) + ":" + std::to_string(ntohs(addr.sin_port));
+        std::thread(serveDevice, fd, peer).detach();
+    }
+}
+
+// 等待比 seq 更新的帧，超时返回空
+static FramePtr waitFrame(uint64_t* seq, int timeoutMs)
+{
+    std::unique_lock<std::mutex> lock(frameLock);
+    frameReady.wait_for(lock, std::chrono::milliseconds(timeoutMs),
+                        [&] { return latestSeq != *seq && latestFrame; });
+    if (latestSeq == *seq || !latestFrame) return FramePtr();
+    *seq = latestSeq;
+    return latestFrame;
+}
+
+// ==== HTTP观看者 ================================================
+static void serveViewer(int fd)
+{
+    // 读取请求头，只关心请求行中的路径
+    std::string req;
+    char buf[512];
+    while (req.find("\r\n\r\n") == std::string::npos && req.size() < 8192) {
+        ssize_t n = recv(fd, buf, sizeof(buf), 0);
+        if (n <= 0) {
+            close(fd);
+            return;
+        }
+        req.append(buf, n);
+    }
+    size_t sp1 = req.find(' ');
+    size_t sp2 = req.find(' ', sp1 + 1);
+    std::string path = sp1 == std::string::npos ? "" : req.substr(sp1 + 1, sp2 - sp1 - 1);
+    path = path.substr(0, path.find('?'));
+
+    // 卡住的观看者在超时后断开
+    timeval tv = { 10, 0 };
+    setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &tv, sizeof(tv));
+
+    uint64_t seq = 0;
+    if (path == "/mjpeg/1") {
+        bool ok = sendAll(fd, HEADER, strlen(HEADER)) && sendAll(fd, BOUNDARY, strlen(BOUNDARY));
+        while (ok) {
+            FramePtr frame = waitFrame(&seq, 1000);
+            if (!frame) {
+                ok = !peerClosed(fd);
+                continue;
+            }
+            char part[80];
+            int n = snprintf(part, sizeof(part), "Content-Type: image/jpeg\r\nContent-Length: %zu\r\n\r\n", frame->size());
+            ok = sendAll(fd, part, n) &&
+                 sendAll(fd, frame->data(), frame->size()) &&
+                 sendAll(fd, BOUNDARY, strlen(BOUNDARY));
+        }
+    }
+    else if (path == "/jpg") {
+        FramePtr frame = waitFrame(&seq, 5000);
+        if (frame) {
+            char len[64];
+            int n = snprintf(len, sizeof(len), "Content-Length: %zu\r\n\r\n", frame->size());
+            if (sendAll(fd, JHEADER, strlen(JHEADER)) && sendAll(fd, len, n))
+                sendAll(fd, frame->data(), frame->size());
+        }
+        else {
+            const char msg[] = "HTTP/1.1 503 Service Unavailable\r\nContent-Length: 0\r\n\r\n";
+            sendAll(fd, msg, strlen(msg));
+        }
+    }
+    else {
+        const char msg[] = "HTTP/1.1 404 Not Found\r\nContent-Length: 0\r\n\r\n";
+        sendAll(fd, msg, strlen(msg));
+    }
+    close(fd);
+}
+
+int main(int argc, char** argv)
+{
+    int ingestPort = argc > 1 ? atoi(argv[1]) : 8081;
+    int httpPort = argc > 2 ? atoi(argv[2]) : 8080;
+
+    signal(SIGPIPE, SIG_IGN);
+    setvbuf(stdout, NULL, _IOLBF, 0);
+
+    int ingest = listenOn(ingestPort);
+    int http = listenOn(httpPort);
+    if (ingest < 0 || http < 0) {
+        fprintf(stderr, "无法监听端口 %d/%d\n", ingestPort, httpPort);
+        return 1;
+    }
+    printf("设备推流端口: %d，观看: http://<host>:%d/mjpeg/1\n", ingestPort, httpPort);
+
+    std::thread(ingestLoop, ingest).detach();
+
+    for (;;) {
+        int fd = accept(http, NULL, NULL);
+        if (fd < 0) continue;
+        int one = 1;
+        setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+        std::thread(serveViewer, fd).detach();
+    }
+}